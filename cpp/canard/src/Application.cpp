@@ -6,10 +6,14 @@
 #include "parser/Parser.h"
 #include "core/macros.h"
 #include "parser/Message.h"
+#include "data/Snapshot.h"
+#include "Server.h"
 #include <cstdlib>
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <csignal>
+#include <atomic>
 
 const char *Application::HELP_PAGE = "Usage:\n"
                                      "  canard [<options>] [<source files>]\n"
@@ -18,14 +22,41 @@ const char *Application::HELP_PAGE = "Usage:\n"
                                      "  --help               Show help page.\n"
                                      "  --threads <number>   Specify the amount of threads used for searching, by default 1.\n"
                                      "  --depth <number>     Specify the maximum search depth, by default 5.\n"
+                                     "  --premises <number>  Specify the number of theorems first tried for goals of unknown type, by default all.\n"
+                                     "  --suspend <path>     Specify a file to which a proof is written when interrupted, and from which it is resumed.\n"
+                                     "  --snapshot <path>    Specify a file to which the session is written after parsing the source files, and from which it is loaded as long as they do not change. Statements in the source files are then not run.\n"
+                                     "  --server <path>      Serve requests over a Unix domain socket at the given path, instead of reading from stdin.\n"
+                                     "  --trace              Specify the query tree of every search result is logged.\n"
                                      "  --namespaces         Specify identifiers are printed with namespace.\n"
                                      "  --json               Specify the output messages to be printed in JSON.\n"
                                      "  --docs <path>        Write JSON documentation file.\n"
                                      "  --defs <path>        Write JSON definition file.";
 
+#ifndef PATH_MAX
+#define PATH_MAX (1024)
+#endif
+
+std::string normalize_path(const std::string &path) {
+    // Convert path to normalized path
+    char normalized_path[PATH_MAX]; // PATH_MAX includes the \0 so +1 is not required
+    char *result = realpath(path.c_str(), normalized_path);
+    if (!result) return "";
+    return normalized_path;
+}
+
+std::atomic<bool> interrupted(false);
+std::atomic<int> interrupt_signal(0);
+
+void interrupt(int signal) {
+    // Searches are interrupted at the first signal, and a second signal terminates as usual
+    interrupt_signal = signal;
+    interrupted = true;
+    std::signal(signal, SIG_DFL);
+}
+
 Application::Application(const std::vector<std::string> &arguments) {
     std::vector<std::string> files;
-    std::string path_documentation, path_definitions;
+    std::string path_documentation, path_definitions, path_snapshot;
 
     // Parse arguments
     for (auto it = arguments.begin(); it != arguments.end(); ++it) {
@@ -45,6 +76,10 @@ Application::Application(const std::vector<std::string> &arguments) {
             m_options.show_namespaces = true;
             continue;
         }
+        if (arg == "--trace") {
+            m_options.trace = true;
+            continue;
+        }
         if (arg == "--threads") {
             if (++it == arguments.end()) {
                 CANARD_LOG("Number of threads missing");
@@ -70,6 +105,48 @@ Application::Application(const std::vector<std::string> &arguments) {
             }
             continue;
         }
+        if (arg == "--premises") {
+            if (++it == arguments.end()) {
+                CANARD_LOG("Number of premises missing");
+                continue;
+            }
+            try {
+                m_options.max_search_premises = std::max(0, std::stoi(*it));
+            } catch (const std::exception &e) {
+                CANARD_LOG("Invalid number of premises");
+            }
+            continue;
+        }
+        if (arg == "--suspend") {
+            if (++it == arguments.end()) {
+                CANARD_LOG("Path for suspend file missing");
+                continue;
+            }
+            m_options.suspend_file = *it;
+            m_options.interrupt = &interrupted;
+            std::signal(SIGINT, interrupt);
+            std::signal(SIGTERM, interrupt);
+            continue;
+        }
+        if (arg == "--server") {
+            if (++it == arguments.end()) {
+                CANARD_LOG("Path for socket missing");
+                continue;
+            }
+            m_server_path = *it;
+            m_options.interrupt = &interrupted;
+            std::signal(SIGINT, interrupt);
+            std::signal(SIGTERM, interrupt);
+            continue;
+        }
+        if (arg == "--snapshot") {
+            if (++it == arguments.end()) {
+                CANARD_LOG("Path for snapshot file missing");
+                continue;
+            }
+            path_snapshot = *it;
+            continue;
+        }
         if (arg == "--docs") {
             m_options.documentation = true;
             if (++it == arguments.end()) {
@@ -90,10 +167,35 @@ Application::Application(const std::vector<std::string> &arguments) {
         files.push_back(arg);
     }
 
-    // Parse files
-    for (const auto &file: files) {
-        if (!parse_file(file))
-            CANARD_LOG("Failed to parse '" << file << "'");
+    // Parse files, or load the session from the snapshot if it is up to date (note: the statements in the files are not run then)
+    std::unique_ptr<Snapshot> snapshot;
+    bool loaded = false;
+    if (!path_snapshot.empty()) {
+        std::vector<std::string> paths;
+        for (const auto &file: files)
+            paths.push_back(normalize_path(file));
+        snapshot.reset(new Snapshot(path_snapshot, std::move(paths)));
+        auto start_time = std::chrono::system_clock::now();
+        loaded = snapshot->load(m_session, m_documentation);
+        auto end_time = std::chrono::system_clock::now();
+        if (loaded) {
+            CANARD_LOG("Loading snapshot " << path_snapshot << " took "
+                                           << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count()
+                                           << " ms");
+            CANARD_LOG("Statements in the source files (such as searches) are not run when the snapshot is loaded");
+        }
+    }
+    if (!loaded) {
+        bool success = true;
+        for (const auto &file: files) {
+            if (!parse_file(file)) {
+                CANARD_LOG("Failed to parse '" << file << "'");
+                success = false;
+            }
+        }
+        // Only a session that was loaded completely is written
+        if (snapshot != nullptr && success && !interrupted)
+            snapshot->save(m_session, m_documentation);
     }
 
     // Write documentation
@@ -105,24 +207,23 @@ Application::Application(const std::vector<std::string> &arguments) {
         write_definitions(path_definitions);
 }
 
-void Application::run() {
-    if (!should_run) return;
-    // Create parser and keep parsing (until exit) via System.in
-    Parser parser(std::cin, std::cout, m_session, m_options);
-    parser.set_documentation(&m_documentation);
-    parser.parse();
-}
-
-#ifndef PATH_MAX
-#define PATH_MAX (1024)
-#endif
-
-std::string normalize_path(const std::string &path) {
-    // Convert path to normalized path
-    char normalized_path[PATH_MAX]; // PATH_MAX includes the \0 so +1 is not required
-    char *result = realpath(path.c_str(), normalized_path);
-    if (!result) return "";
-    return normalized_path;
+int Application::run() {
+    if (should_run && !interrupted) {
+        if (!m_server_path.empty()) {
+            // Serve requests of clients over a socket (until interrupted)
+            Server server(m_session, m_options, m_documentation);
+            server.run(m_server_path);
+            return EXIT_SUCCESS;
+        }
+        // Create parser and keep parsing (until exit) via System.in
+        Parser parser(std::cin, std::cout, m_session, m_options);
+        parser.set_documentation(&m_documentation);
+        parser.parse();
+    }
+    // When interrupted (e.g. during a proof, which is then suspended), the statements were not all run
+    if (interrupted)
+        return 128 + interrupt_signal;
+    return EXIT_SUCCESS;
 }
 
 bool Application::parse_file(const std::string &path) {
@@ -134,6 +235,7 @@ bool Application::parse_file(const std::string &path) {
 
     // Create input file stream
     std::ifstream input(n_path);
+    m_session.add_source(n_path);
     if (!input.good()) {
         CANARD_LOG("Could not open '" << n_path << "'");
         return false;
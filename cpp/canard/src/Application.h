@@ -12,7 +12,7 @@ public:
 
     explicit Application(const std::vector<std::string> &);
 
-    void run();
+    int run(); // returns the exit status
 
 private:
 
@@ -22,6 +22,7 @@ private:
     Parser::Options m_options = {};
     std::unordered_map<std::string, std::string> m_documentation;
     bool should_run = true;
+    std::string m_server_path; // socket on which requests are served, if any
 
     bool parse_file(const std::string &);
     void write_documentation(const std::string &);
@@ -0,0 +1,388 @@
+#include "Server.h"
+#include "parser/Message.h"
+#include "core/macros.h"
+#include <thread>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_REQUEST_SIZE (1 << 20)
+#define POLL_TIMEOUT (100) // ms, how often the server checks whether it should stop
+#define MAX_JSON_DEPTH (64) // nesting of arrays and objects in a request
+#define MAX_CLIENTS (16) // clients that are served at the same time
+#define MAX_REQUEST_DEPTH (10) // search depth of a request
+#define MAX_REQUEST_QUERIES (1000000) // queries per search of a request
+
+// The parts of JSON that are used by requests
+struct JsonValue {
+    enum Type {
+        NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT
+    } type = NUL;
+    std::string data; // contents of a string, or the text of a number or boolean
+    std::vector<JsonValue> elements;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue *get(const std::string &key) const {
+        for (const auto &member: members) {
+            if (member.first == key)
+                return &member.second;
+        }
+        return nullptr;
+    }
+};
+
+struct JsonException : public std::exception {
+
+    const std::string m_message;
+
+    explicit JsonException(std::string message) : m_message(std::move(message)) {};
+};
+
+class JsonReader {
+public:
+
+    explicit JsonReader(const std::string &text) : m_text(text) {}
+
+    JsonValue read() {
+        JsonValue value = read_value(0);
+        skip_whitespace();
+        if (m_offset != m_text.size())
+            throw JsonException("unexpected characters after value");
+        return value;
+    }
+
+private:
+
+    const std::string &m_text;
+    size_t m_offset = 0;
+
+    void skip_whitespace() {
+        while (m_offset < m_text.size() && (m_text[m_offset] == ' ' || m_text[m_offset] == '\t' || m_text[m_offset] == '\r' || m_text[m_offset] == '\n'))
+            ++m_offset;
+    }
+
+    bool accept(char c) {
+        skip_whitespace();
+        if (m_offset < m_text.size() && m_text[m_offset] == c) {
+            ++m_offset;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(c))
+            throw JsonException(std::string("expected '") + c + "'");
+    }
+
+    JsonValue read_value(int depth) {
+        skip_whitespace();
+        if (m_offset == m_text.size())
+            throw JsonException("unexpected end of request");
+        if (depth > MAX_JSON_DEPTH)
+            throw JsonException("too deeply nested");
+
+        JsonValue value;
+        const char c = m_text[m_offset];
+        if (c == '{') {
+            value.type = JsonValue::OBJECT;
+            ++m_offset;
+            if (accept('}'))
+                return value;
+            do {
+                skip_whitespace();
+                std::string key = read_string();
+                expect(':');
+                value.members.emplace_back(std::move(key), read_value(depth + 1));
+            } while (accept(','));
+            expect('}');
+        } else if (c == '[') {
+            value.type = JsonValue::ARRAY;
+            ++m_offset;
+            if (accept(']'))
+                return value;
+            do {
+                value.elements.push_back(read_value(depth + 1));
+            } while (accept(','));
+            expect(']');
+        } else if (c == '"') {
+            value.type = JsonValue::STRING;
+            value.data = read_string();
+        } else {
+            // Literals and numbers are kept as text
+            const size_t begin = m_offset;
+            while (m_offset < m_text.size() && (isalnum((unsigned char) m_text[m_offset]) || strchr("+-.", m_text[m_offset]) != nullptr))
+                ++m_offset;
+            value.data = m_text.substr(begin, m_offset - begin);
+            if (value.data == "true" || value.data == "false")
+                value.type = JsonValue::BOOLEAN;
+            else if (value.data == "null")
+                value.type = JsonValue::NUL;
+            else if (!value.data.empty() && (value.data[0] == '-' || isdigit((unsigned char) value.data[0])))
+                value.type = JsonValue::NUMBER;
+            else
+                throw JsonException("invalid value");
+        }
+        return value;
+    }
+
+    std::string read_string() {
+        if (m_offset == m_text.size() || m_text[m_offset] != '"')
+            throw JsonException("expected string");
+        ++m_offset;
+        std::string string;
+        while (true) {
+            if (m_offset == m_text.size())
+                throw JsonException("unexpected end of string");
+            const char c = m_text[m_offset++];
+            if (c == '"')
+                return string;
+            if (c != '\\') {
+                string.push_back(c);
+                continue;
+            }
+            if (m_offset == m_text.size())
+                throw JsonException("unexpected end of string");
+            const char e = m_text[m_offset++];
+            switch (e) {
+                case 'b':
+                    string.push_back('\b');
+                    break;
+                case 'f':
+                    string.push_back('\f');
+                    break;
+                case 'n':
+                    string.push_back('\n');
+                    break;
+                case 'r':
+                    string.push_back('\r');
+                    break;
+                case 't':
+                    string.push_back('\t');
+                    break;
+                case 'u': {
+                    // Encode the code point in UTF-8 (surrogate pairs are not supported)
+                    if (m_offset + 4 > m_text.size())
+                        throw JsonException("invalid escape");
+                    const unsigned long u = std::strtoul(m_text.substr(m_offset, 4).c_str(), nullptr, 16);
+                    m_offset += 4;
+                    if (u < 0x80) {
+                        string.push_back((char) u);
+                    } else if (u < 0x800) {
+                        string.push_back((char) (0xC0 | (u >> 6)));
+                        string.push_back((char) (0x80 | (u & 0x3F)));
+                    } else {
+                        string.push_back((char) (0xE0 | (u >> 12)));
+                        string.push_back((char) (0x80 | ((u >> 6) & 0x3F)));
+                        string.push_back((char) (0x80 | (u & 0x3F)));
+                    }
+                    break;
+                }
+                default:
+                    string.push_back(e);
+                    break;
+            }
+        }
+    }
+
+};
+
+std::string json_id(const JsonValue *id) {
+    if (id == nullptr || id->type == JsonValue::NUL)
+        return "null";
+    if (id->type == JsonValue::STRING)
+        return '"' + Message::json_escape(id->data) + '"';
+    return id->data;
+}
+
+std::string json_error(const std::string &id, int code, const std::string &message) {
+    return R"({"jsonrpc":"2.0","id":)" + id + R"(,"error":{"code":)" + std::to_string(code) + R"(,"message":")" + Message::json_escape(message) + "\"}}";
+}
+
+Server::Server(Session &session, Parser::Options options, std::unordered_map<std::string, std::string> &documentation)
+        : m_session(session), m_options(std::move(options)), m_documentation(documentation) {
+    // Clients get their messages in JSON, and cannot change anything outside their requests
+    // Also, their searches are bounded so that a single request cannot occupy the server
+    m_options.json = true;
+    m_options.store_documentation = false;
+    m_options.imports = false;
+    m_options.suspend_file.clear();
+    m_options.max_search_depth = std::min(m_options.max_search_depth, MAX_REQUEST_DEPTH);
+    m_options.max_search_queries = MAX_REQUEST_QUERIES;
+}
+
+bool Server::stopped() const {
+    return m_options.interrupt != nullptr && m_options.interrupt->load();
+}
+
+bool Server::run(const std::string &path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        CANARD_ERROR("Socket path '" << path << "' is too long");
+        return false;
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (fd < 0 || bind(fd, (sockaddr *) &address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        CANARD_ERROR("Could not listen on '" << path << "': " << strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    // Clients that disconnect while their response is written should not terminate the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    CANARD_LOG("Listening on " << path);
+    while (!stopped()) {
+        pollfd poll_fd = {fd, POLLIN, 0};
+        if (poll(&poll_fd, 1, POLL_TIMEOUT) <= 0)
+            continue;
+        const int client = accept(fd, nullptr, nullptr);
+        if (client < 0)
+            continue;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_clients >= MAX_CLIENTS) {
+            // Refuse the client, rather than starting arbitrarily many threads
+            const std::string response = json_error("null", -32000, "too many clients") + '\n';
+            if (write(client, response.data(), response.size()) < 0)
+                CANARD_LOG("Could not refuse client: " << strerror(errno));
+            close(client);
+            continue;
+        }
+        ++m_clients;
+        std::thread(&Server::serve, this, client).detach();
+    }
+    close(fd);
+    unlink(path.c_str());
+
+    // Wait for the clients, which stop as well
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() { return m_clients == 0; });
+    return true;
+}
+
+void Server::serve(int fd) {
+    // Requests are separated by newlines, and are handled one after another
+    std::string buffer;
+    char chunk[1 << 12];
+    bool connected = true;
+    while (connected && !stopped()) {
+        pollfd poll_fd = {fd, POLLIN, 0};
+        if (poll(&poll_fd, 1, POLL_TIMEOUT) <= 0)
+            continue;
+        const ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        buffer.append(chunk, (size_t) n);
+
+        size_t begin = 0, end;
+        while (connected && (end = buffer.find('\n', begin)) != std::string::npos) {
+            const std::string request = buffer.substr(begin, end - begin);
+            begin = end + 1;
+            if (request.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            const std::string response = handle(request) + '\n';
+            for (size_t written = 0; connected && written < response.size();) {
+                const ssize_t m = write(fd, response.data() + written, response.size() - written);
+                if (m < 0 && errno == EINTR)
+                    continue;
+                connected = (m > 0);
+                written += (m > 0) ? (size_t) m : 0;
+            }
+        }
+        buffer.erase(0, begin);
+        if (buffer.size() > MAX_REQUEST_SIZE)
+            break;
+    }
+    close(fd);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    --m_clients;
+    m_cv.notify_all();
+}
+
+std::string Server::handle(const std::string &request) {
+    /*
+        { "jsonrpc": "2.0", "id": ID, "method": "check" | "search" | "prove" | "docs", "params": { "input": STRING, "context": STRING } }
+     */
+
+    JsonValue value;
+    try {
+        value = JsonReader(request).read();
+    } catch (JsonException &e) {
+        return json_error("null", -32700, "parse error: " + e.m_message);
+    }
+    const std::string id = json_id(value.get("id"));
+    const JsonValue *method = value.get("method");
+    const JsonValue *params = value.get("params");
+    if (value.type != JsonValue::OBJECT || method == nullptr || method->type != JsonValue::STRING)
+        return json_error(id, -32600, "invalid request");
+    if (method->data != "check" && method->data != "search" && method->data != "prove" && method->data != "docs")
+        return json_error(id, -32601, "method not found");
+    const JsonValue *input = (params != nullptr) ? params->get("input") : nullptr;
+    const JsonValue *context = (params != nullptr) ? params->get("context") : nullptr;
+    if (input == nullptr || input->type != JsonValue::STRING || (context != nullptr && context->type != JsonValue::STRING))
+        return json_error(id, -32602, "invalid params");
+
+    // The context (e.g. definitions) is parsed first, followed by the statement of the method
+    // Note: the parser only accepts declarations in the context, and nothing after the statement
+    std::string source = (context != nullptr) ? context->data + '\n' : std::string();
+    source += method->data + ' ' + input->data + '\n';
+
+    // Errors in the input are reported by the parser as messages. Anything else that goes wrong only fails this request,
+    // and not the server (and the requests of the other clients with it).
+    std::vector<std::string> messages;
+    try {
+        messages = evaluate(source, method->data);
+    } catch (const std::exception &e) {
+        CANARD_LOG("Request failed: " << e.what());
+        return json_error(id, -32603, std::string("internal error: ") + e.what());
+    }
+
+    std::ostringstream ss;
+    ss << R"({"jsonrpc":"2.0","id":)" << id << R"(,"result":[)";
+    bool first = true;
+    for (const auto &message: messages) {
+        if (!first)
+            ss << ',';
+        first = false;
+        ss << message;
+    }
+    ss << "]}";
+    return ss.str();
+}
+
+std::vector<std::string> Server::evaluate(const std::string &source, const std::string &method) {
+    // The request is parsed in a fork of the session, so that whatever it adds is only visible to itself
+    const auto fork = m_session.fork();
+    std::ostringstream output;
+    {
+        Parser parser(Scanner(source), output, *fork, m_options);
+        parser.set_documentation(&m_documentation);
+        parser.set_request(method);
+        parser.parse();
+    }
+
+    // Every line of output is a message
+    std::vector<std::string> messages;
+    std::istringstream lines(output.str());
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (!line.empty())
+            messages.push_back(std::move(line));
+    }
+    return messages;
+}
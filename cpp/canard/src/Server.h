@@ -0,0 +1,35 @@
+#pragma once
+
+#include "data/Session.h"
+#include "parser/Parser.h"
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+
+// Serves requests of multiple clients over a Unix domain socket, using the session that was loaded once.
+// Requests are JSON-RPC 2.0 objects, one per line. Every request is parsed in its own fork of the session,
+// so that the definitions of one request are not seen by any other request.
+class Server {
+public:
+
+    Server(Session &, Parser::Options, std::unordered_map<std::string, std::string> &);
+
+    bool run(const std::string &);
+
+private:
+
+    Session &m_session;
+    Parser::Options m_options;
+    std::unordered_map<std::string, std::string> &m_documentation;
+
+    int m_clients = 0; // number of clients that are being served
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    bool stopped() const;
+    void serve(int);
+    std::string handle(const std::string &);
+    std::vector<std::string> evaluate(const std::string &, const std::string &);
+
+};
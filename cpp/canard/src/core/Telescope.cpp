@@ -34,6 +34,8 @@ Telescope Telescope::operator+(const Telescope &other) const {
 }
 
 std::vector<Telescope> Telescope::split() const {
+    if (m_functions.empty())
+        return {};
     // Create a vector of group indices
     std::vector<int> groups(m_functions.size());
     std::iota(groups.begin(), groups.end(), 0);
@@ -64,5 +66,7 @@ std::vector<Telescope> Telescope::split() const {
     std::vector<Telescope> telescopes(N);
     for (int i = 0; i < m_functions.size(); ++i)
         telescopes[groups[i]].add(m_functions[i]);
+    // Groups that were merged into others are empty, so remove them
+    telescopes.erase(std::remove_if(telescopes.begin(), telescopes.end(), [](const Telescope &t) { return t.empty(); }), telescopes.end());
     return telescopes;
 }
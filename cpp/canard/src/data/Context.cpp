@@ -10,6 +10,20 @@ Context::Context() : m_parent(nullptr), m_is_space(true), m_name(std::string()),
 
 Context::Context(Context &parent) : m_parent(&parent), m_name(std::string()), m_is_space(false), m_full_name(std::string()) {}
 
+Context::Context(Context *parent, Context &base) : m_parent(parent),
+                                                  m_base(&base),
+                                                  m_is_space(base.m_is_space),
+                                                  m_name(base.m_name),
+                                                  m_full_name(base.m_full_name) {
+    // A fork has a fork of every subspace of its base, so that it has the same structure of namespaces
+    for (const auto &entry: base.m_subspaces)
+        m_subspaces.emplace(entry.first, entry.second->fork(this));
+}
+
+std::unique_ptr<Context> Context::fork(Context *parent) {
+    return std::unique_ptr<Context>(new Context(parent, *this));
+}
+
 Context::Context(Context &parent, std::string name) : m_parent(&parent),
                                                       m_is_space(true),
                                                       m_name(std::move(name)),
@@ -23,10 +37,11 @@ bool Context::put(const std::string &path, const FunctionRef &f, bool only_refer
         return get_subspace(prefix).put(suffix, f, only_reference);
     }
 
-    if (m_functions.find(path) != m_functions.end())
+    if (m_functions.find(path) != m_functions.end() || (m_base != nullptr && m_base->get(path) != nullptr))
         return false;
 
     m_functions.emplace(path, f);
+    m_history.push_back(f);
     if (!only_reference) {
         f->set_name(path);
         if (is_space())
@@ -47,7 +62,7 @@ const FunctionRef &Context::get(const std::string &path) const {
     auto it = m_functions.find(path);
     if (it != m_functions.end())
         return it->second;
-    return FunctionRef::null();
+    return (m_base != nullptr) ? m_base->get(path) : FunctionRef::null();
 }
 
 Context *Context::find_subspace(const std::string &path) {
@@ -113,6 +128,6 @@ void Context::set_preference(const FunctionRef &f, int x) {
 int Context::get_preference(const FunctionRef &f) {
     auto it = m_preferences.find(f);
     if (it == m_preferences.end())
-        return DEFAULT_PREFERENCE;
+        return (m_base != nullptr) ? m_base->get_preference(f) : DEFAULT_PREFERENCE;
     return it->second;
 }
@@ -16,11 +16,16 @@ public:
     Context(Context &);
     Context(Context &, std::string);
 
+    // A fork of a namespace has a fork of every subspace, and sees the functions of the namespace without changing them
+    std::unique_ptr<Context> fork(Context *parent);
+
     Context *parent() const { return m_parent; }
+    Context *base() const { return m_base; }
     const std::string &name() const { return m_name; }
     const std::string &full_name() const { return m_full_name; }
-    const std::unordered_map<std::string, FunctionRef> &functions() const { return m_functions; }
+    const std::unordered_map<std::string, FunctionRef> &functions() const { return m_functions; } // (of a fork, only its own functions)
     const std::unordered_map<std::string, std::unique_ptr<Context>> &subspaces() const { return m_subspaces; }
+    const std::vector<FunctionRef> &history() const { return m_history; } // functions in the order in which they were put (of a fork, only its own functions)
 
     bool put(const std::string &, const FunctionRef &, bool only_reference = false);
     const FunctionRef &get(const std::string &) const;
@@ -32,18 +37,23 @@ public:
 
     void set_preference(const FunctionRef &, int);
     int get_preference(const FunctionRef &);
+    const std::unordered_map<FunctionRef, int> &preferences() const { return m_preferences; }
 
 private:
 
     Context *const m_parent = nullptr;
+    Context *const m_base = nullptr; // namespace of which this is a fork, whose functions are visible but not changed
     const bool m_is_space;
     const std::string m_name;
     const std::string m_full_name;
 
     std::unordered_map<std::string, FunctionRef> m_functions;
+    std::vector<FunctionRef> m_history;
     std::unordered_map<std::string, std::unique_ptr<Context>> m_subspaces;
     std::unordered_map<FunctionRef, int> m_preferences;
 
+    Context(Context *, Context &);
+
     Context *create_subspace(const std::string &);
 
 };
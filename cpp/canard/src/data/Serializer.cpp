@@ -0,0 +1,249 @@
+#include "Serializer.h"
+
+enum Tag : uint8_t {
+    NONE, // null
+    REFERENCE, // a function that was written before, by its id
+    NAMED, // a function of the session, by its namespace and name
+    PARAMETER, // a parameter of a function, by its index
+    CONSTRUCTOR, // the constructor of a structure
+    BASE, // a new base function
+    SPECIALIZATION // a new specialization
+};
+
+Serializer::Serializer(std::ostream &ostream, const Context *global_namespace) : m_ostream(ostream),
+                                                                                 m_global_namespace(global_namespace) {}
+
+void Serializer::declare(const FunctionRef &f) {
+    // Functions that are known to the deserializer as well, see `Deserializer::declare`. They are referred to by their id.
+    const auto id = m_ids.size();
+    m_ids.emplace(f, id);
+}
+
+void Serializer::write_int(uint64_t n) {
+    // Integers are written with 7 bits per byte, the highest bit indicates whether more bytes follow
+    while (n >= 0x80) {
+        m_ostream.put((char) ((n & 0x7f) | 0x80));
+        n >>= 7;
+    }
+    m_ostream.put((char) n);
+}
+
+void Serializer::write_string(const std::string &string) {
+    write_int(string.size());
+    m_ostream.write(string.data(), (std::streamsize) string.size());
+}
+
+void Serializer::write(const FunctionRef &f) {
+    if (f == nullptr) {
+        m_ostream.put(NONE);
+        return;
+    }
+
+    auto it = m_ids.find(f);
+    if (it != m_ids.end()) {
+        m_ostream.put(REFERENCE);
+        write_int(it->second);
+        return;
+    }
+
+    // Functions of the session are referred to by their name, and their parameters by their index
+    // Note: functions that f consists of are written before f gets its id, the deserializer reads them in the same order
+    if (is_named(f)) {
+        m_ostream.put(NAMED);
+        write_string(((const Context *) f->space())->full_name());
+        write_string(f->name());
+    } else {
+        if (!m_owners_computed) {
+            if (m_global_namespace != nullptr)
+                compute_owners(*m_global_namespace);
+            m_owners_computed = true;
+        }
+        auto it_owner = m_owners.find(f);
+        if (it_owner != m_owners.end()) {
+            m_ostream.put(PARAMETER);
+            write(it_owner->second.first);
+            write_int(it_owner->second.second);
+        } else if (f->is_base() && f->is_constructor()) {
+            // A constructor is written by its structure, whose definition may include the constructor itself (see `define`)
+            m_ostream.put(CONSTRUCTOR);
+            write(f.type().base());
+            const bool defined = m_ids.count(f) != 0;
+            write_int(defined);
+            if (defined)
+                return;
+        } else {
+            define(f);
+            return;
+        }
+    }
+
+    const auto id = m_ids.size();
+    m_ids.emplace(f, id);
+}
+
+void Serializer::define(const FunctionRef &f) {
+    m_ostream.put(f->is_base() ? BASE : SPECIALIZATION);
+    write_string(f->name());
+    write_int(f->implicit());
+    write(f->parameters().functions());
+    write(f.type());
+    if (!f->is_base()) {
+        write(f.base());
+        write(f->arguments());
+        write(f->constructor());
+    }
+
+    const auto id = m_ids.size();
+    m_ids.emplace(f, id);
+
+    // The constructor of a base function (i.e. a structure) is written after the function has its id, as it refers back to it
+    if (f->is_base()) {
+        const auto &constructor = f->constructor();
+        if (constructor != nullptr && m_ids.count(constructor) == 0 && !is_named(constructor) && m_owners.count(constructor) == 0)
+            define(constructor);
+        else
+            write(constructor);
+    }
+}
+
+void Serializer::write(const std::vector<FunctionRef> &functions) {
+    write_int(functions.size());
+    for (const auto &f: functions)
+        write(f);
+}
+
+bool Serializer::is_named(const FunctionRef &f) const {
+    // A function can be found by its name if it is stored under that name in a namespace of the session
+    const auto space = (const Context *) f->space();
+    return m_global_namespace != nullptr && space != nullptr && !f->name().empty() && space->get(f->name()) == f
+           && m_global_namespace->find_subspace(space->full_name()) == space;
+}
+
+void Serializer::compute_owners(const Context &space) {
+    for (const auto &entry: space.functions())
+        compute_owners(entry.second);
+    for (const auto &entry: space.subspaces())
+        compute_owners(*entry.second);
+}
+
+void Serializer::compute_owners(const FunctionRef &f) {
+    const auto &parameters = f->parameters().functions();
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        if (m_owners.emplace(parameters[i], std::make_pair(f, i)).second)
+            compute_owners(parameters[i]);
+    }
+}
+
+Deserializer::Deserializer(std::istream &istream, const Context *global_namespace) : m_istream(istream),
+                                                                                     m_global_namespace(global_namespace) {}
+
+void Deserializer::declare(const FunctionRef &f) {
+    m_functions.push_back(f);
+}
+
+uint64_t Deserializer::read_int() {
+    uint64_t n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const int c = m_istream.get();
+        if (c == std::char_traits<char>::eof())
+            throw SerializationException("unexpected end of file");
+        n |= (uint64_t) (c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return n;
+    }
+    throw SerializationException("invalid integer");
+}
+
+std::string Deserializer::read_string() {
+    const auto size = read_int();
+    std::string string;
+    string.resize(size);
+    if (!m_istream.read(&string[0], (std::streamsize) size))
+        throw SerializationException("unexpected end of file");
+    return string;
+}
+
+FunctionRef Deserializer::read() {
+    const int tag = m_istream.get();
+    if (tag == std::char_traits<char>::eof())
+        throw SerializationException("unexpected end of file");
+
+    FunctionRef f;
+    switch (tag) {
+        case NONE:
+            return nullptr;
+        case REFERENCE: {
+            const auto id = read_int();
+            if (id >= m_functions.size())
+                throw SerializationException("invalid reference");
+            return m_functions[id];
+        }
+        case NAMED: {
+            const auto path = read_string();
+            const auto name = read_string();
+            const auto space = (m_global_namespace != nullptr) ? m_global_namespace->find_subspace(path) : nullptr;
+            f = (space != nullptr) ? space->get(name) : nullptr;
+            if (f == nullptr)
+                throw SerializationException("could not find '" + (path.empty() ? name : path + '.' + name) + "'");
+            break;
+        }
+        case PARAMETER: {
+            const auto owner = read();
+            const auto index = read_int();
+            if (owner == nullptr || index >= owner->parameters().size())
+                throw SerializationException("invalid parameter");
+            f = owner->parameters().functions()[index];
+            break;
+        }
+        case CONSTRUCTOR: {
+            const auto structure = read();
+            const bool defined = read_int() != 0;
+            f = (structure != nullptr) ? structure->constructor() : nullptr;
+            if (f == nullptr)
+                throw SerializationException("invalid constructor");
+            if (defined)
+                return f;
+            break;
+        }
+        case BASE:
+        case SPECIALIZATION: {
+            const auto name = read_string();
+            const bool implicit = read_int() != 0;
+            auto parameters = read_functions();
+            const auto type = read();
+            if (tag == BASE) {
+                f = Function::make(Telescope(std::move(parameters)), type);
+            } else {
+                const auto base = read();
+                auto arguments = read_functions();
+                const auto constructor = read();
+                if (base == nullptr)
+                    throw SerializationException("invalid specialization");
+                f = Function::make(Telescope(std::move(parameters)), type, base, std::move(arguments));
+                f->set_constructor(constructor);
+            }
+            f->set_name(name);
+            f->set_implicit(implicit);
+            if (tag == BASE) {
+                // See `Serializer::define`
+                m_functions.push_back(f);
+                f->set_constructor(read());
+                return f;
+            }
+            break;
+        }
+        default:
+            throw SerializationException("invalid function");
+    }
+
+    m_functions.push_back(f);
+    return f;
+}
+
+std::vector<FunctionRef> Deserializer::read_functions() {
+    const auto size = read_int();
+    std::vector<FunctionRef> functions;
+    for (uint64_t i = 0; i < size; ++i)
+        functions.push_back(read());
+    return functions;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Context.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Writes (graphs of) functions in a binary format. Every function is written only once, later occurrences refer to it.
+// If a namespace is given, its functions are written by their name (or as parameter of such a function), so that they can
+// be found again by a `Deserializer` in another process which loaded the same session. Otherwise, all functions are written in full.
+class Serializer {
+public:
+
+    explicit Serializer(std::ostream &, const Context * = nullptr);
+
+    void declare(const FunctionRef &);
+    void write_int(uint64_t);
+    void write_string(const std::string &);
+    void write(const FunctionRef &);
+    void write(const std::vector<FunctionRef> &);
+
+    bool good() const { return m_ostream.good(); }
+    const std::unordered_map<FunctionRef, uint64_t> &ids() const { return m_ids; } // functions that were written (or declared) so far
+
+private:
+
+    std::ostream &m_ostream;
+    const Context *m_global_namespace;
+    std::unordered_map<FunctionRef, uint64_t> m_ids;
+    std::unordered_map<FunctionRef, std::pair<FunctionRef, size_t>> m_owners; // parameters of named functions, by their function and index
+    bool m_owners_computed = false;
+
+    void define(const FunctionRef &);
+    bool is_named(const FunctionRef &) const;
+    void compute_owners(const Context &);
+    void compute_owners(const FunctionRef &);
+
+};
+
+class Deserializer {
+public:
+
+    explicit Deserializer(std::istream &, const Context * = nullptr);
+
+    void declare(const FunctionRef &);
+    uint64_t read_int();
+    std::string read_string();
+    FunctionRef read();
+    std::vector<FunctionRef> read_functions();
+
+private:
+
+    std::istream &m_istream;
+    const Context *m_global_namespace;
+    std::vector<FunctionRef> m_functions; // by their id
+
+};
+
+struct SerializationException : public std::exception {
+
+    const std::string m_message;
+
+    explicit SerializationException(std::string message) : m_message(std::move(message)) {};
+};
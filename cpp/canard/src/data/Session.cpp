@@ -3,6 +3,7 @@
 //
 
 #include <memory>
+#include <algorithm>
 #include "Session.h"
 
 Session::Session() {
@@ -14,3 +15,62 @@ Session::Session() {
     m_global_namespace->put("Type", TYPE);
     m_global_namespace->put("Prop", PROP);
 }
+
+Session::Session(Session *parent) : m_parent(parent) {
+    m_global_namespace = parent->global_namespace().fork(nullptr);
+
+    TYPE = parent->TYPE;
+    PROP = parent->PROP;
+}
+
+std::unique_ptr<Session> Session::fork() {
+    return std::unique_ptr<Session>(new Session(this));
+}
+
+std::shared_ptr<const Index> Session::index(const std::unordered_set<Context *> &spaces, const int threads) {
+    // A fork uses the index of its parent for the namespaces it forked, and adds its own functions to a copy of it
+    // (the lists of theorems are shared until they are changed). These indices only live as long as a single parser,
+    // so they are not stored.
+    if (m_parent != nullptr) {
+        std::unordered_set<Context *> parent_spaces;
+        for (const auto space: spaces) {
+            if (space->base() != nullptr)
+                parent_spaces.insert(space->base());
+        }
+        auto index = std::make_shared<Index>(*m_parent->index(parent_spaces, threads));
+        parent_spaces.insert(spaces.begin(), spaces.end());
+        index->update(parent_spaces);
+        return index;
+    }
+
+    // Indices are immutable, so they can be shared between parsers and searchers. They are identified
+    // by their set of namespaces, and the number of functions in each of them (which only increases).
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Context *> key(spaces.begin(), spaces.end());
+    std::sort(key.begin(), key.end());
+    std::vector<size_t> versions;
+    versions.reserve(key.size());
+    for (const auto space: key)
+        versions.push_back(space->history().size());
+
+    auto it = m_indices.find(key);
+    if (it == m_indices.end()) {
+        auto index = std::make_shared<const Index>(spaces, threads);
+        m_indices.emplace(std::move(key), IndexEntry{std::move(versions), index});
+        return index;
+    }
+
+    // If functions were added since, derive a new index from the previous one
+    auto &entry = it->second;
+    if (entry.versions != versions) {
+        auto index = std::make_shared<Index>(*entry.index);
+        index->update(spaces);
+        entry.versions = std::move(versions);
+        entry.index = std::move(index);
+    }
+    return entry.index;
+}
+
+void Session::add_source(const std::string &path) {
+    m_sources.push_back(path);
+}
@@ -5,19 +5,46 @@
 #pragma once
 
 #include "Context.h"
+#include "../searcher/Index.h"
+#include <unordered_set>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
 
 class Session {
 private:
 
+    Session *const m_parent = nullptr; // session of which this is a fork
     std::unique_ptr<Context> m_global_namespace;
 
+    struct IndexEntry {
+        std::vector<size_t> versions; // number of functions in each namespace when the index was made
+        std::shared_ptr<const Index> index;
+    };
+    std::map<std::vector<Context *>, IndexEntry> m_indices; // latest index per (sorted) set of namespaces
+    std::vector<std::string> m_sources; // files that were parsed into the session
+    std::mutex m_mutex; // guards the indices, as parsers on different threads may share the session
+
+    explicit Session(Session *);
+
 public:
 
     Session();
+    Session(const Session &) = delete;
+
+    // A fork shares the functions and namespaces of this session, and only stores what is added to it
+    std::unique_ptr<Session> fork();
 
     FunctionRef TYPE = nullptr;
     FunctionRef PROP = nullptr;
 
     Context &global_namespace() { return *m_global_namespace; };
+    const Context &global_namespace() const { return *m_global_namespace; };
+
+    const std::vector<std::string> &sources() const { return m_sources; }
+    void add_source(const std::string &);
+
+    std::shared_ptr<const Index> index(const std::unordered_set<Context *> &, int = 1);
 
 };
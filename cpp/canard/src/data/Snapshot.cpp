@@ -0,0 +1,218 @@
+#include "Snapshot.h"
+#include "Serializer.h"
+#include "../core/macros.h"
+#include <fstream>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+
+const char *SNAPSHOT_HEADER = "canard snapshot 2";
+
+// The contents of a namespace, which are only put in the session once the whole snapshot is read
+struct SpaceContents {
+    std::string name;
+    std::vector<std::pair<std::string, FunctionRef>> functions; // in the order in which they were put
+    std::vector<std::pair<FunctionRef, int>> preferences;
+    std::vector<std::unique_ptr<SpaceContents>> subspaces;
+};
+
+bool file_status(const std::string &path, uint64_t &size, uint64_t &hash) {
+    // The size and a (FNV-1a) hash of the contents of a file. Note: modification times are not used, since
+    // they are too coarse (e.g. in seconds) to notice every change
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    size = 0;
+    hash = 0xcbf29ce484222325ULL;
+    char chunk[1 << 16];
+    while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0) {
+        const auto n = (size_t) file.gcount();
+        for (size_t i = 0; i < n; ++i)
+            hash = (hash ^ (uint8_t) chunk[i]) * 0x100000001b3ULL;
+        size += n;
+    }
+    return !file.bad();
+}
+
+void write_space(Serializer &serializer, const Context &space) {
+    // The names of the functions are found from the map of functions, the order from the history
+    std::unordered_map<FunctionRef, std::vector<const std::string *>> names;
+    for (const auto &entry: space.functions())
+        names[entry.second].push_back(&entry.first);
+    serializer.write_int(space.history().size());
+    for (const auto &f: space.history()) {
+        auto &f_names = names[f];
+        serializer.write_string(*f_names.back());
+        f_names.pop_back();
+        serializer.write(f);
+    }
+
+    serializer.write_int(space.preferences().size());
+    for (const auto &entry: space.preferences()) {
+        serializer.write(entry.first);
+        serializer.write_int((uint64_t) (int64_t) entry.second);
+    }
+
+    serializer.write_int(space.subspaces().size());
+    for (const auto &entry: space.subspaces()) {
+        serializer.write_string(entry.first);
+        write_space(serializer, *entry.second);
+    }
+}
+
+void read_space(Deserializer &deserializer, SpaceContents &contents) {
+    contents.functions.resize(deserializer.read_int());
+    for (auto &entry: contents.functions) {
+        entry.first = deserializer.read_string();
+        entry.second = deserializer.read();
+        if (entry.second == nullptr)
+            throw SerializationException("invalid namespace");
+    }
+
+    contents.preferences.resize(deserializer.read_int());
+    for (auto &entry: contents.preferences) {
+        entry.first = deserializer.read();
+        entry.second = (int) (int64_t) deserializer.read_int();
+    }
+
+    const auto subspaces = deserializer.read_int();
+    for (uint64_t i = 0; i < subspaces; ++i) {
+        std::unique_ptr<SpaceContents> subspace(new SpaceContents());
+        subspace->name = deserializer.read_string();
+        read_space(deserializer, *subspace);
+        contents.subspaces.push_back(std::move(subspace));
+    }
+}
+
+void put_space(Context &space, const SpaceContents &contents) {
+    // Note: the functions already have their names (and their spaces are set afterwards), so they are only put as references
+    // The functions that are already in the namespace, i.e. `Type` and `Prop`, are not put again
+    for (const auto &entry: contents.functions)
+        space.put(entry.first, entry.second, true);
+    for (const auto &entry: contents.preferences)
+        space.set_preference(entry.first, entry.second);
+    for (const auto &subspace: contents.subspaces)
+        put_space(space.get_subspace(subspace->name), *subspace);
+}
+
+Snapshot::Snapshot(std::string path, std::vector<std::string> files) : m_path(std::move(path)),
+                                                                      m_files(std::move(files)) {}
+
+bool Snapshot::load(Session &session, std::unordered_map<std::string, std::string> &documentation) const {
+    std::ifstream file(m_path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    try {
+        Deserializer deserializer(file);
+        deserializer.declare(session.TYPE);
+        deserializer.declare(session.PROP);
+
+        // The snapshot can only be used if the same files are loaded, and the files have not changed since
+        if (deserializer.read_string() != SNAPSHOT_HEADER)
+            return false;
+        const auto files = deserializer.read_int();
+        if (files != m_files.size())
+            return false;
+        for (const auto &f: m_files) {
+            if (deserializer.read_string() != f)
+                return false;
+        }
+        std::vector<std::string> sources(deserializer.read_int());
+        for (auto &source: sources) {
+            source = deserializer.read_string();
+            const auto size = deserializer.read_int();
+            const auto hash = deserializer.read_int();
+            uint64_t actual_size, actual_hash;
+            if (!file_status(source, actual_size, actual_hash) || actual_size != size || actual_hash != hash) {
+                CANARD_LOG("Snapshot '" << m_path << "' is outdated");
+                return false;
+            }
+        }
+
+        // First read everything, and only then put it in the session
+        SpaceContents global_namespace;
+        read_space(deserializer, global_namespace);
+        std::vector<std::pair<FunctionRef, std::string>> spaces(deserializer.read_int());
+        for (auto &entry: spaces) {
+            entry.first = deserializer.read();
+            entry.second = deserializer.read_string();
+            if (entry.first == nullptr)
+                throw SerializationException("invalid function");
+        }
+        std::vector<std::pair<std::string, std::string>> docs(deserializer.read_int());
+        for (auto &entry: docs) {
+            entry.first = deserializer.read_string();
+            entry.second = deserializer.read_string();
+        }
+
+        put_space(session.global_namespace(), global_namespace);
+        for (const auto &entry: spaces)
+            entry.first->set_space(&session.global_namespace().get_subspace(entry.second));
+        for (auto &entry: docs)
+            documentation.emplace(std::move(entry.first), std::move(entry.second));
+        for (const auto &source: sources)
+            session.add_source(source);
+        return true;
+    } catch (SerializationException &e) {
+        CANARD_ERROR("Could not load snapshot '" << m_path << "': " << e.m_message);
+        return false;
+    }
+}
+
+bool Snapshot::save(const Session &session, const std::unordered_map<std::string, std::string> &documentation) const {
+    // The snapshot is written to a temporary file first, so that an incomplete snapshot is never used
+    const std::string path = m_path + ".tmp";
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        CANARD_ERROR("Could not write snapshot '" << m_path << "'");
+        return false;
+    }
+
+    Serializer serializer(file);
+    serializer.declare(session.TYPE);
+    serializer.declare(session.PROP);
+
+    serializer.write_string(SNAPSHOT_HEADER);
+    serializer.write_int(m_files.size());
+    for (const auto &f: m_files)
+        serializer.write_string(f);
+    serializer.write_int(session.sources().size());
+    for (const auto &source: session.sources()) {
+        uint64_t size = 0, hash = 0;
+        file_status(source, size, hash);
+        serializer.write_string(source);
+        serializer.write_int(size);
+        serializer.write_int(hash);
+    }
+
+    write_space(serializer, session.global_namespace());
+
+    // The spaces of the functions, in the order in which they were written
+    std::vector<std::pair<uint64_t, FunctionRef>> functions;
+    for (const auto &entry: serializer.ids()) {
+        if (entry.first->space() != nullptr)
+            functions.emplace_back(entry.second, entry.first);
+    }
+    std::sort(functions.begin(), functions.end(), [](const std::pair<uint64_t, FunctionRef> &a, const std::pair<uint64_t, FunctionRef> &b) {
+        return a.first < b.first;
+    });
+    serializer.write_int(functions.size());
+    for (const auto &entry: functions) {
+        serializer.write(entry.second);
+        serializer.write_string(((const Context *) entry.second->space())->full_name());
+    }
+    serializer.write_int(documentation.size());
+    for (const auto &entry: documentation) {
+        serializer.write_string(entry.first);
+        serializer.write_string(entry.second);
+    }
+
+    file.close();
+    if (file.fail() || std::rename(path.c_str(), m_path.c_str()) != 0) {
+        std::remove(path.c_str());
+        CANARD_ERROR("Could not write snapshot '" << m_path << "'");
+        return false;
+    }
+    return true;
+}
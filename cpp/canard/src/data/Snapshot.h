@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Session.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// A snapshot of a session that was loaded from source files, so that it can be loaded again without parsing those files.
+// A snapshot is only used as long as the same files are loaded, and none of the files (or their imports) have changed.
+class Snapshot {
+public:
+
+    Snapshot(std::string path, std::vector<std::string> files);
+
+    bool load(Session &, std::unordered_map<std::string, std::string> &) const;
+    bool save(const Session &, const std::unordered_map<std::string, std::string> &) const;
+
+private:
+
+    const std::string m_path;
+    const std::vector<std::string> m_files; // the files from which the session is loaded, in order
+
+};
@@ -9,6 +9,5 @@ int main(int argc, char *argv[]) {
 
     // Create and run application
     Application application(arguments);
-    application.run();
-    return 0;
+    return application.run();
 }
@@ -211,8 +211,8 @@ void Formatter::write_query(const Query &query) {
     for (int i = 0; i < n; ++i) {
         ss << INDENT << INDENT;
         write_definition(query.telescope().functions()[i]);
-        ss << " [depth = " << query.depths()[i];
-        ss << ", ctx_depth = " << query.locals_depths()[i] << "]\n";
+        ss << " [depth = " << query.depths()[i].depth;
+        ss << ", ctx_depth = " << query.depths()[i].locals_depth << "]\n";
     }
     ss << "}";
 }
@@ -2,28 +2,60 @@
 // Created by Jesse Vogel on 01/07/2021.
 //
 
-#include <algorithm>
+#include <cstring>
 #include "Lexer.h"
 #include "../core/macros.h"
 
-const std::unordered_set<std::string> &Lexer::keywords() {
-    static const std::unordered_set<std::string> KEYWORDS(
-            {
-                    "let", "check", "search", "import", "namespace", "end", "open", "close", "structure",
-                    "exit", "docs", "prove"
-#ifdef DEBUG
-                    , "debug_search"
-#endif
-            });
-    return KEYWORDS;
+// Classes of characters, which determine what token a character starts (or whether it continues a word)
+enum CharClass : uint8_t {
+    OTHER, // not part of any token
+    SPACE,
+    BREAK, // '\n' or '\r'
+    WORD, // letters and '_'
+    DIGIT,
+    QUOTE,
+    PUNCTUATION // a separator, or the start of one
+};
+
+static const uint8_t *char_classes() {
+    static const uint8_t *CLASSES = []() {
+        static uint8_t classes[256] = {};
+        for (int c = 'a'; c <= 'z'; ++c) classes[c] = WORD;
+        for (int c = 'A'; c <= 'Z'; ++c) classes[c] = WORD;
+        for (int c = '0'; c <= '9'; ++c) classes[c] = DIGIT;
+        classes[(uint8_t) '_'] = WORD;
+        classes[(uint8_t) ' '] = classes[(uint8_t) '\t'] = SPACE;
+        classes[(uint8_t) '\n'] = classes[(uint8_t) '\r'] = BREAK;
+        classes[(uint8_t) '"'] = QUOTE;
+        for (const char c: std::string(":(){}[];.*\\,%-/"))
+            classes[(uint8_t) c] = PUNCTUATION;
+        classes[0xCE] = PUNCTUATION; // first byte of 'λ'
+        return classes;
+    }();
+    return CLASSES;
+}
+
+// Hash of a word of at least two characters, under which the keywords do not collide
+static inline size_t keyword_hash(const char *data, size_t length) {
+    return ((uint8_t) data[0] + 2 * (uint8_t) data[1] + 5 * length) % 32;
 }
 
-const std::unordered_set<std::string> &Lexer::separators() {
-    static const std::unordered_set<std::string> SEPARATORS(
-            {
-                    ":", "(", ")", "{", "}", "[", "]", "_", ";", ".", ":=", "--", "*", "\\", "λ", "->", ",", "%"
-            });
-    return SEPARATORS;
+static const char *const *keyword_table() {
+    static const char *const *TABLE = []() {
+        static const char *table[32] = {};
+        for (const char *keyword: {"let", "check", "search", "import", "namespace", "end", "open", "close", "structure",
+                                   "exit", "docs", "prove"
+#ifdef DEBUG
+                , "debug_search"
+#endif
+        }) {
+            auto &slot = table[keyword_hash(keyword, strlen(keyword))];
+            CANARD_ASSERT(slot == nullptr, "keywords collide in keyword table");
+            slot = keyword;
+        }
+        return table;
+    }();
+    return TABLE;
 }
 
 const char *Lexer::to_string(const TokenType &type) {
@@ -49,195 +81,132 @@ const char *Lexer::to_string(const TokenType &type) {
     }
 }
 
-bool Lexer::is_keyword(const std::string &str) {
-    return keywords().count(str);
-}
-
-bool Lexer::is_separator(const std::string &str) {
-    return separators().count(str);
-}
-
-bool Lexer::is_number(const std::string &str) {
-    for (char c: str)
-        if (!(c >= '0' && c <= '9'))
-            return false;
-    return true;
-}
-
-bool Lexer::is_word(const std::string &str) {
-    for (char c: str)
-        if (!(c >= 'a' && c <= 'z') && !(c >= 'A' && c <= 'Z') && c != '_' && !(c >= '0' && c <= '9'))
-            return false;
-    return true;
-}
-
-bool Lexer::is_string(const std::string &str) {
-    const size_t n = str.size();
-    return (n >= 2 && str[0] == '"' && str[n - 1] == '"');
-}
-
-bool Lexer::is_newline(const std::string &str) {
-    const size_t n = str.size();
-    return (n == 1 && str[0] == '\n') || (n == 2 && str[0] == '\r' && str[1] == '\n');
+bool Lexer::is_keyword(const char *data, size_t length) {
+    if (length < 2)
+        return false;
+    const char *keyword = keyword_table()[keyword_hash(data, length)];
+    return keyword != nullptr && strlen(keyword) == length && memcmp(keyword, data, length) == 0;
 }
 
 Lexer::Lexer(Scanner &scanner) : m_scanner(scanner) {}
 
 Token Lexer::get_token() {
-    // If there are tokens in the FIFO queue, use those first
-    if (!m_queue.empty()) {
-        Token token = std::move(m_queue.front());
-        m_queue.pop();
-        return token;
-    }
-
-    // Read characters until a new Token is produced
+    const uint8_t *classes = char_classes();
     while (true) {
-        int c = m_scanner.get_char();
+        const int c = m_scanner.peek();
+        const int line = m_scanner.line(), position = m_scanner.position();
 
         // End of file
-        if (c == -1) {
-            if (m_stream_length == 0)
-                return {END_OF_FILE, std::string(), m_scanner.line(), m_scanner.position()};
-            if (!tokenize(m_stream.str()))
-                throw LexerException(m_current_token.m_line, m_current_token.m_position, "unexpected end of file");
-            return make_token();
-        }
-
-        // Whitespace: always marks the end of a get_token (if there currently is one)
-        if (c == ' ' || c == '\t') {
-            if (m_stream_length != 0)
-                return make_token();
-            continue;
-        }
-
-        // Line comments (--): mark the end of a get_token (if there currently is one),
-        // then continue discarding characters until a newline appears
-        if (c == '-' && m_scanner.get_previous_char() == '-') {
-            // Remove the first '-'
-            stream_remove_back();
-
-            // If the stream is non-empty, force a token
-            if (m_stream_length > 0)
-                m_queue.push(make_token());
-
-            // Read until a newline or end-of-file
-            while (true) {
-                c = m_scanner.get_char();
-                if (c != -1 && c != '\n')
-                    m_stream << (char) c;
-                else
-                    break;
+        if (c == -1)
+            return {END_OF_FILE, std::string(), line, position};
+
+        const char *begin = m_scanner.current();
+        switch (classes[c]) {
+            case SPACE: {
+                // Whitespace only separates tokens
+                size_t n = 1;
+                for (int d = m_scanner.peek(n); d != -1 && classes[d] == SPACE; d = m_scanner.peek(n))
+                    ++n;
+                m_scanner.advance(n);
+                continue;
             }
-
-            // Create a comment Token
-            m_queue.push({COMMENT, m_stream.str(), m_current_token.m_line, m_current_token.m_position});
-            reset_token();
-
-            // Include the newlines if it follows
-            if (c == '\n')
-                m_queue.push({NEWLINE, "\n", m_current_token.m_line, m_current_token.m_position});
-
-            return get_token();
-        }
-
-        // Block comments (/- * -/): do a similar thing as line comments
-        if (c == '-' && m_scanner.get_previous_char() == '/') {
-            // Remove the '/' from the sb before making a get_token!
-            stream_remove_back();
-
-            // If the stream is non-empty, force a token
-            if (m_stream_length > 0)
-                m_queue.push(make_token());
-
-            // Read until a newline or end-of-file
-            while (true) {
-                c = m_scanner.get_char();
-                if (c == -1)
-                    throw LexerException(m_scanner.line(), m_scanner.position(), "unexpected end of file");
-                if (!(m_scanner.get_previous_char() == '-' && c == '/'))
-                    m_stream << (char) c;
-                else
-                    break;
+            case BREAK: {
+                const size_t n = (c == '\r') ? 2 : 1;
+                if (c == '\r' && m_scanner.peek(1) != '\n')
+                    throw unrecognized(line, position);
+                m_scanner.advance(n);
+                return {NEWLINE, std::string(begin, n), line, position};
             }
-
-            // Create a comment Token
-            std::string comment = m_stream.str();
-            comment.pop_back(); // remove the final '-'
-            m_queue.push({COMMENT, std::move(comment), m_current_token.m_line, m_current_token.m_position});
-            reset_token();
-
-            return get_token();
+            case WORD:
+            case DIGIT: {
+                // Words consist of letters, digits and '_'. Words of only digits are numbers, and '_' itself is a separator.
+                size_t n = 1;
+                bool digits = (classes[c] == DIGIT);
+                while (true) {
+                    const int d = m_scanner.peek(n);
+                    if (d == -1 || (classes[d] != WORD && classes[d] != DIGIT))
+                        break;
+                    digits = digits && classes[d] == DIGIT;
+                    ++n;
+                }
+                m_scanner.advance(n);
+                const TokenType type = digits ? NUMBER
+                                              : (n == 1 && c == '_') ? SEPARATOR
+                                                                     : is_keyword(begin, n) ? KEYWORD : IDENTIFIER;
+                return {type, std::string(begin, n), line, position};
+            }
+            case QUOTE: {
+                // Strings (including their quotes) do not contain whitespace
+                size_t n = 1;
+                while (true) {
+                    const int d = m_scanner.peek(n);
+                    if (d == -1 || classes[d] == SPACE || classes[d] == BREAK)
+                        throw unrecognized(line, position);
+                    ++n;
+                    if (d == '"')
+                        break;
+                }
+                m_scanner.advance(n);
+                return {STRING, std::string(begin, n), line, position};
+            }
+            case PUNCTUATION: {
+                const int d = m_scanner.peek(1);
+                if (c == '-' && d == '-')
+                    return read_comment(line, position);
+                if (c == '/' && d == '-')
+                    return read_block_comment(line, position);
+                size_t n = 1;
+                if ((c == ':' && d == '=') || (c == '-' && d == '>') || (c == 0xCE && d == 0xBB))
+                    n = 2;
+                else if (c == '-' || c == '/' || c == 0xCE)
+                    throw unrecognized(line, position);
+                m_scanner.advance(n);
+                return {SEPARATOR, std::string(begin, n), line, position};
+            }
+            default:
+                throw unrecognized(line, position);
         }
-
-        // Enlarge the get_token if possible
-        m_stream << (char) c;
-        m_stream_length++;
-
-        // If can tokenize, just continue
-        if (tokenize(m_stream.str()))
-            continue;
-
-        // If we also did not tokenize before, hope that it will make sense later
-        if (m_current_token.m_type == NONE)
-            continue;
-
-        // Return the last valid get_token
-        Token token = make_token();
-        m_stream << (char) c;
-        ++m_stream_length;
-        tokenize(m_stream.str());
-        return token;
     }
 }
 
-bool Lexer::tokenize(std::string str) {
-    TokenType type;
-    if (is_keyword(str))
-        type = KEYWORD;
-    else if (is_separator(str))
-        type = SEPARATOR;
-    else if (is_newline(str))
-        type = NEWLINE;
-    else if (is_number(str))
-        type = NUMBER;
-    else if (is_word(str))
-        type = IDENTIFIER;
-    else if (is_string(str)) {
-        type = STRING;
-//        str = str.substring(1, str.length() - 1);
-    } else
-        return false;
-
-    // So that there are not constantly made new instances of Token
-    m_current_token.m_type = type;
-    m_current_token.m_data = std::move(str);
-    return true;
-}
-
-Token Lexer::make_token() {
-    if (m_current_token.m_type == NONE) {
-        std::string message = "unrecognized token '" + m_stream.str() + "'";
-        m_stream.str(std::string());
-        m_stream_length = 0;
-        throw LexerException(m_current_token.m_line, m_current_token.m_position, std::move(message));
+Token Lexer::read_comment(int line, int position) {
+    // Line comments (--) continue until a newline or end-of-file, the newline itself is a separate token
+    m_scanner.advance(2);
+    const char *begin = m_scanner.current(), *end = m_scanner.end();
+    const char *newline = (const char *) memchr(begin, '\n', end - begin);
+    if (newline != nullptr) {
+        end = newline;
+        if (end > begin && end[-1] == '\r')
+            --end;
     }
-
-    Token token = m_current_token;
-    reset_token();
-    return token;
+    m_scanner.advance(end - begin);
+    return {COMMENT, std::string(begin, end), line, position};
 }
 
-void Lexer::reset_token() {
-    m_current_token.m_type = NONE;
-    m_current_token.m_line = m_scanner.line(); // TODO: set these correctly at the correct place
-    m_current_token.m_position = m_scanner.position();
-    m_stream.str(std::string());
-    m_stream_length = 0;
+Token Lexer::read_block_comment(int line, int position) {
+    // Block comments (/- ... -/) may span multiple refills of the scanner (i.e. lines in the REPL), which never end with
+    // a '-', so that the closing '-/' is always found within a single refill
+    m_scanner.advance(2);
+    std::string comment;
+    while (m_scanner.peek() != -1) {
+        const char *begin = m_scanner.current(), *end = m_scanner.end();
+        for (const char *p = begin; p + 1 < end; ++p) {
+            if (p[0] == '-' && p[1] == '/') {
+                comment.append(begin, p);
+                m_scanner.advance(p + 2 - begin);
+                return {COMMENT, std::move(comment), line, position};
+            }
+        }
+        comment.append(begin, end);
+        m_scanner.advance(end - begin);
+    }
+    throw LexerException(m_scanner.line(), m_scanner.position(), "unexpected end of file");
 }
 
-void Lexer::stream_remove_back() {
-    // Remove the last character and update length
-    m_stream.seekp(-1, m_stream.cur);
-    --m_stream_length;
+LexerException Lexer::unrecognized(int line, int position) {
+    // The unrecognized token continues up to the next whitespace
+    const char *begin = m_scanner.current(), *end = begin;
+    while (end < m_scanner.end() && *end != ' ' && *end != '\t' && *end != '\n' && *end != '\r')
+        ++end;
+    return LexerException(line, position, "unrecognized token '" + std::string(begin, end) + "'");
 }
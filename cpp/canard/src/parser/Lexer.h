@@ -6,9 +6,7 @@
 
 #include <utility>
 #include <vector>
-#include <unordered_set>
-#include <sstream>
-#include <queue>
+#include <string>
 #include "Scanner.h"
 
 enum TokenType {
@@ -32,6 +30,16 @@ struct Token {
 
 };
 
+struct LexerException : public std::exception {
+
+    const int m_line, m_position;
+    const std::string m_message;
+
+    explicit LexerException(int line, int position, std::string message) : m_line(line), m_position(position),
+                                                                           m_message(std::move(message)) {};
+
+};
+
 class Lexer {
 public:
 
@@ -42,37 +50,11 @@ public:
     Token get_token();
 
 private:
-    static const std::unordered_set<std::string> &keywords();
-    static const std::unordered_set<std::string> &separators();
-
-    static bool is_keyword(const std::string &);
-    static bool is_separator(const std::string &);
-    static bool is_number(const std::string &);
-    static bool is_word(const std::string &);
-    static bool is_string(const std::string &);
-    static bool is_newline(const std::string &);
+    static bool is_keyword(const char *, size_t);
 
     Scanner &m_scanner;
 
-    Token m_current_token = {NONE};
-    std::stringstream m_stream;
-    int m_stream_length = 0;
-
-    std::queue<Token> m_queue;
-
-    bool tokenize(std::string);
-    Token make_token();
-    void reset_token();
-
-    void stream_remove_back();
-};
-
-struct LexerException : public std::exception {
-
-    const int m_line, m_position;
-    const std::string m_message;
-
-    explicit LexerException(int line, int position, std::string message) : m_line(line), m_position(position),
-                                                                           m_message(std::move(message)) {};
-
+    Token read_comment(int, int);
+    Token read_block_comment(int, int);
+    LexerException unrecognized(int, int);
 };
@@ -7,11 +7,17 @@
 #include "../searcher/Searcher.h"
 #include "../core/macros.h"
 #include "../searcher/DebugSearcher.h"
+#include "../data/Serializer.h"
 #include <fstream>
 #include <algorithm>
+#include <cstdio>
+#include <stdexcept>
 
 Parser::Parser(std::istream &istream, std::ostream &ostream, Session &session, Options options)
-        : m_ostream(ostream), m_scanner(istream),
+        : Parser(Scanner(istream), ostream, session, std::move(options)) {}
+
+Parser::Parser(Scanner scanner, std::ostream &ostream, Session &session, Options options)
+        : m_ostream(ostream), m_scanner(std::move(scanner)),
           m_lexer(m_scanner),
           m_session(session),
           m_options(options) {
@@ -42,7 +48,7 @@ void trim(std::string &s) { // trim from both ends (in place)
 
 void Parser::next_token() {
     // Remember comments containing documentation (i.e. comments starting with '-')
-    if (m_options.documentation && m_current_token.m_type == COMMENT && m_current_token.m_data.rfind('-', 0) == 0) {
+    if (m_options.documentation && m_options.store_documentation && m_current_token.m_type == COMMENT && m_current_token.m_data.rfind('-', 0) == 0) {
         m_documentation_token = std::move(m_current_token);
         m_documentation_token.m_data.erase(0, 1); // removes the first '-'
         trim(m_documentation_token.m_data); // removes leading and trailing whitespace
@@ -105,7 +111,11 @@ Token Parser::consume(TokenType type, const std::string &data) {
 bool Parser::parse() {
     try {
         m_running = true;
-        while (m_running && parse_statement());
+        while (m_running && parse_statement()) {
+            // Stop parsing when interrupted
+            if (m_options.interrupt != nullptr && m_options.interrupt->load())
+                m_running = false;
+        }
         if (m_running) {
             if (!found(END_OF_FILE)) {
                 std::ostringstream ss;
@@ -147,6 +157,18 @@ bool Parser::parse_statement() {
         return true;
     }
 
+    // A request consists of declarations, followed by a single statement of the requested kind
+    if (!m_request.empty() && m_current_token.m_type == KEYWORD) {
+        static const std::unordered_set<std::string> declarations = {"let", "structure", "namespace", "end", "open", "close", "import"};
+        if (m_request_parsed)
+            throw ParserException(m_current_token, "unexpected " + m_current_token.m_data + " after " + m_request);
+        if (!declarations.count(m_current_token.m_data)) {
+            if (m_current_token.m_data != m_request)
+                throw ParserException(m_current_token, "unexpected " + m_current_token.m_data + " in " + m_request + " request");
+            m_request_parsed = true;
+        }
+    }
+
     if (found(KEYWORD, "check")) {
         parse_check();
         return true;
@@ -180,9 +202,6 @@ bool Parser::parse_statement() {
     }
 #endif
 
-    // Every statement below this point invalidates the searcher
-    m_searcher = nullptr;
-
     if (found(KEYWORD, "let")) {
         parse_definition();
         return true;
@@ -256,6 +275,8 @@ void Parser::parse_import() {
      */
 
     Token t_import = consume(KEYWORD, "import");
+    if (!m_options.imports)
+        throw ParserException(t_import, "cannot import files here");
     std::string filename = consume(STRING).m_data;
     filename = filename.substr(1, filename.length() - 2); // removes surrounding (")
 
@@ -277,6 +298,7 @@ void Parser::parse_import() {
 
     // Add the absolute path to list of imported files
     m_imported_files->insert(path);
+    m_session.add_source(path);
 
     // Create input file stream
     std::ifstream ifstream(absolute_path);
@@ -426,13 +448,36 @@ void Parser::parse_check() {
 void Parser::parse_search() {
     /*
         search INT? LIST_OF_PARAMETERS
+        search * INT? LIST_OF_PARAMETERS
+        search more INT?
      */
 
     consume(KEYWORD, "search");
 
+    // Note: `more` is not a keyword, so that it can still be used as identifier (a list of parameters cannot start with it)
+    if (found(IDENTIFIER, "more")) {
+        parse_more();
+        return;
+    }
+
+    // A search with `*` has no maximum number of results. Instead, the results are given in pages
+    // (of 10 results by default), and the search is paused after every page until `search more` is called.
+    if (found(SEPARATOR, "*")) {
+        consume();
+        const int page_size = (found(NUMBER) ? std::max(1, parse_number()) : 10);
+        auto context = std::unique_ptr<Context>(new Context(*m_current_namespace));
+        Telescope telescope = parse_parameters(*context);
+        setup_searcher();
+        m_page_context = std::move(context);
+        m_page_telescope = std::move(telescope);
+        m_page_size = page_size;
+        search_page(false, page_size);
+        return;
+    }
+
     // Parse maximum number of results, with default of 1
     // Also, a maximum of 10 for time/memory/cpu safety
-    const int max_results = (found(NUMBER) ? std::max(0, std::min(10, stoi(consume().m_data))) : 1);
+    const int max_results = (found(NUMBER) ? std::max(0, std::min(10, parse_number())) : 1);
 
     // Parse telescope
     Context sub_context(*m_current_namespace);
@@ -443,38 +488,50 @@ void Parser::parse_search() {
     setup_searcher();
 
     // Do a search, and store the solutions in a vector of unordered_map's by name
+    // The i'th results of all groups together form the i'th result, so the results can be output
+    // as soon as they are found for the last group
     std::vector<std::unordered_map<std::string, FunctionRef>> solutions(max_results);
     bool success = true;
     int query_counter = 0;
     size_t actual_results = max_results; // keep track of how many results are actually obtained (take minimum over all groups)
+    size_t output_results = 0;
     auto start_time = std::chrono::system_clock::now();
-    for (auto it = groups.begin(); success && it != groups.end(); ++it) {
-        if (success &= m_searcher->search(*it, max_results)) {
+    for (auto it = groups.begin(); success && !m_searcher->interrupted() && it != groups.end(); ++it) {
+        const auto &group = *it;
+        const bool last = (std::next(it) == groups.end());
+        if (last) {
+            m_searcher->set_result_callback([&](const std::vector<FunctionRef> &searcher_result) {
+                if (output_results >= actual_results)
+                    return;
+                auto &solution = solutions[output_results++];
+                for (int j = 0; j < group.size(); ++j)
+                    solution.emplace(group.functions()[j]->name(), searcher_result[j]);
+                std::vector<FunctionRef> result;
+                result.reserve(telescope.size());
+                for (const auto &f: telescope.functions())
+                    result.push_back(solution[f->name()]);
+                output_search_results(telescope, {result});
+            });
+        }
+        if ((success &= m_searcher->search(group, max_results)) && !last) {
             const auto &searcher_results = m_searcher->results();
             actual_results = std::min(actual_results, searcher_results.size());
             for (int i = 0; i < actual_results; ++i) {
                 auto &solution = solutions[i];
                 const auto &searcher_result = searcher_results[i];
-                for (int j = 0; j < it->size(); ++j)
-                    solution.emplace(it->functions()[j]->name(), searcher_result[j]);
+                for (int j = 0; j < group.size(); ++j)
+                    solution.emplace(group.functions()[j]->name(), searcher_result[j]);
             }
         }
         query_counter += m_searcher->query_counter();
     }
+    if (interrupted_search())
+        return;
+    m_searcher->set_result_callback(nullptr);
     auto end_time = std::chrono::system_clock::now();
 
-    // Print results in appropriate format
-    if (success) {
-        std::vector<std::vector<FunctionRef>> results(actual_results);
-        for (int i = 0; i < actual_results; ++i) {
-            auto &solution = solutions[i];
-            auto &result = results[i];
-            result.reserve(telescope.size());
-            for (const auto &f: telescope.functions())
-                result.push_back(solution[f->name()]);
-        }
-        output_search_results(telescope, results);
-    } else {
+    // If there are no results, say so in appropriate format
+    if (!success) {
         if (m_options.json)
             output(Message::create(SUCCESS, std::vector<std::string>()));
         else {
@@ -489,6 +546,25 @@ void Parser::parse_search() {
     m_searcher->clear();
 }
 
+void Parser::parse_more() {
+    /*
+        more INT?
+     */
+
+    consume(IDENTIFIER, "more");
+
+    // Give the next page of results of the last paginated search (by default of the same size as before)
+    const int page_size = (found(NUMBER) ? std::max(1, parse_number()) : m_page_size);
+    if (m_searcher == nullptr || !m_searcher->can_resume()) {
+        if (m_options.json)
+            output(Message::create(SUCCESS, std::vector<std::string>()));
+        else
+            output("🥺 no more solutions found");
+        return;
+    }
+    search_page(true, page_size);
+}
+
 void Parser::parse_prove() {
     /*
         prove EXPRESSION
@@ -505,10 +581,22 @@ void Parser::parse_prove() {
     setup_searcher();
 
     // Do a search, and store the results in a list
+    // If the proof was suspended before, it is resumed instead
     auto start_time = std::chrono::system_clock::now();
-    bool success = m_searcher->prove(f);
+    const bool resumed = load_suspended_search(f);
+    bool success = resumed ? m_searcher->resume() : m_searcher->prove(f);
     auto end_time = std::chrono::system_clock::now();
 
+    // When interrupted, the proof is suspended (if there is a file for it), and parsing stops
+    if (m_searcher->interrupted()) {
+        suspend_search(f);
+        m_searcher->clear();
+        m_running = false;
+        return;
+    }
+    if (resumed)
+        std::remove(m_options.suspend_file.c_str());
+
     // Print results in appropriate format
     if (success) {
         output_search_results(Telescope({f}), m_searcher->results());
@@ -539,7 +627,7 @@ void Parser::parse_docs() {
     if (m_options.documentation && m_documentation != nullptr) {
         auto space = (Context *) f->space();
         if (space) {
-            auto it = m_documentation->find(space->full_name() + '.' + f->name());
+            auto it = m_documentation->find(to_path(*space, f->name()));
             if (it != m_documentation->end())
                 doc = it->second;
         }
@@ -1012,34 +1100,167 @@ std::unordered_set<Context *> Parser::parse_namespace_collection() {
     return {space};
 }
 
+int Parser::parse_number() {
+    /*
+        NUMBER
+     */
+
+    // Numbers consist of digits only, but they may still be too large
+    Token token = consume(NUMBER);
+    try {
+        return std::stoi(token.m_data);
+    } catch (const std::out_of_range &e) {
+        throw ParserException(token, "number " + token.m_data + " is out of range");
+    }
+}
+
 int Parser::parse_preference() {
     /*
         [ NUMBER % ]
      */
 
     consume(SEPARATOR, "[");
-    const int percentage = std::stoi(consume(NUMBER).m_data);
+    const int percentage = parse_number();
     consume(SEPARATOR, "%");
     consume(SEPARATOR, "]");
     return percentage;
 }
 
 void Parser::setup_searcher() {
-    // If already a searcher, nothing to do
-    if (m_searcher != nullptr)
-        return;
     // Create set of namespaces whose theorems to use
     std::unordered_set<Context *> spaces = m_open_namespaces;
     for (auto space = m_current_namespace; space != nullptr; space = space->parent())
         spaces.insert(space);
-    // Create searcher
-    m_searcher = std::unique_ptr<Searcher>(new Searcher(spaces, m_options.max_search_depth, m_options.max_search_threads));
+    // Create searcher, or give the existing searcher an up-to-date index
+    // (namespaces may have been opened or closed, and functions may have been added since)
+    auto index = m_session.index(spaces, m_options.max_search_threads);
+    if (m_searcher == nullptr) {
+        m_searcher = std::unique_ptr<Searcher>(new Searcher(std::move(index), m_options.max_search_depth, m_options.max_search_threads, m_options.max_search_premises, m_options.max_search_queries));
+        m_searcher->set_trace(m_options.trace);
+    }
+    else
+        m_searcher->set_index(std::move(index));
+    // Searches are interrupted once the interrupt flag is set (e.g. when the server stops), see `interrupted_search`
+    m_searcher->set_interrupt(m_options.interrupt);
+}
+
+bool Parser::interrupted_search() {
+    // An interrupted search (other than a proof, which can be suspended) is dropped, and parsing stops
+    if (!m_searcher->interrupted())
+        return false;
+    error("search interrupted");
+    m_searcher->set_result_callback(nullptr);
+    m_searcher->clear();
+    m_running = false;
+    return true;
+}
+
+void Parser::search_page(bool resume, int page_size) {
+    // Output the results as soon as they are found
+    m_searcher->set_result_callback([this](const std::vector<FunctionRef> &result) {
+        output_search_results(m_page_telescope, {result});
+    });
+    auto start_time = std::chrono::system_clock::now();
+    const int query_counter = m_searcher->query_counter();
+    bool success = resume ? m_searcher->resume(page_size) : m_searcher->search(m_page_telescope, page_size, true);
+    if (interrupted_search())
+        return;
+    auto end_time = std::chrono::system_clock::now();
+    m_searcher->set_result_callback(nullptr);
+
+    if (!success) {
+        if (m_options.json)
+            output(Message::create(SUCCESS, std::vector<std::string>()));
+        else
+            output(resume ? "🥺 no more solutions found" : "🥺 no solutions found");
+    }
+
+    CANARD_LOG("Search took " << std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count()
+                              << " ms (using " << m_searcher->query_counter() - (resume ? query_counter : 0) << " queries)");
+
+    // Once the search is exhausted, it can be cleared already
+    if (!m_searcher->can_resume())
+        m_searcher->clear();
 }
 
 void Parser::output(const std::string &message) {
     m_ostream << message << std::endl;
 }
 
+const char *SUSPEND_HEADER = "canard suspended proof 1";
+
+std::string suspend_key(const FunctionRef &f) {
+    // A suspended proof is identified by the full name of the theorem
+    auto space = (Context *) f->space();
+    return space ? to_path(*space, f->name()) : f->name();
+}
+
+bool Parser::read_suspend_key(std::string &key) const {
+    // Read the key of the proof in the suspend file, if it contains one
+    std::ifstream file(m_options.suspend_file, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    try {
+        Deserializer deserializer(file, &m_session.global_namespace());
+        if (deserializer.read_string() != SUSPEND_HEADER)
+            return false;
+        key = deserializer.read_string();
+        return true;
+    } catch (SerializationException &e) {
+        return false;
+    }
+}
+
+bool Parser::load_suspended_search(const FunctionRef &f) {
+    // Load the search from the suspend file, if it exists and contains a proof of f
+    if (m_options.suspend_file.empty())
+        return false;
+    std::ifstream file(m_options.suspend_file, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    try {
+        Deserializer deserializer(file, &m_session.global_namespace());
+        if (deserializer.read_string() != SUSPEND_HEADER)
+            return false;
+        const std::string key = deserializer.read_string();
+        if (key != suspend_key(f)) {
+            CANARD_LOG("'" << m_options.suspend_file << "' contains a suspended proof of '" << key << "', not of '" << suspend_key(f) << "'");
+            return false;
+        }
+        m_searcher->load(deserializer);
+    } catch (SerializationException &e) {
+        CANARD_ERROR("Could not resume from '" << m_options.suspend_file << "': " << e.m_message);
+        m_searcher->clear();
+        return false;
+    }
+    CANARD_LOG("Resuming proof from '" << m_options.suspend_file << "'");
+    return true;
+}
+
+void Parser::suspend_search(const FunctionRef &f) {
+    // Write the interrupted search to the suspend file, so that it can be resumed by `load_suspended_search`
+    if (m_options.suspend_file.empty()) {
+        CANARD_LOG("Search interrupted");
+        return;
+    }
+    // A suspended proof of another theorem is not overwritten, it must be resumed (or removed) first
+    std::string key;
+    if (read_suspend_key(key) && key != suspend_key(f)) {
+        CANARD_ERROR("Search not suspended, since '" << m_options.suspend_file << "' contains a suspended proof of '" << key << "'");
+        return;
+    }
+    std::ofstream file(m_options.suspend_file, std::ios::binary | std::ios::trunc);
+    Serializer serializer(file, &m_session.global_namespace());
+    serializer.write_string(SUSPEND_HEADER);
+    serializer.write_string(suspend_key(f));
+    m_searcher->save(serializer);
+    file.close();
+    if (file.fail())
+        CANARD_ERROR("Could not write '" << m_options.suspend_file << "'");
+    else
+        CANARD_LOG("Search suspended to '" << m_options.suspend_file << "'");
+}
+
 void Parser::output_search_results(const Telescope &telescope, const std::vector<std::vector<FunctionRef>> &results) {
     // Format keys and values
     Formatter formatter;
@@ -1078,7 +1299,7 @@ void Parser::output_search_results(const Telescope &telescope, const std::vector
 
 void Parser::error(const std::string &message) {
     if (m_options.json)
-        output(R"({"status":"error","data":")" + message + "\"}");
+        output(Message::create(ERROR, message));
     else
         output("⚠️ " + message);
 }
@@ -1088,6 +1309,12 @@ void Parser::set_location(std::string &directory, std::string &filename) {
     m_filename = filename;
 }
 
+void Parser::set_request(const std::string &request) {
+    // Only statements of the given kind are allowed (once) besides declarations, e.g. for requests of clients of a server
+    m_request = request;
+    m_request_parsed = false;
+}
+
 void Parser::set_documentation(std::unordered_map<std::string, std::string> *documentation) {
     m_documentation = documentation;
 }
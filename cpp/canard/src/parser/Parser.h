@@ -10,6 +10,7 @@
 #include "../data/Context.h"
 #include "../searcher/Searcher.h"
 #include <unordered_set>
+#include <atomic>
 
 class Parser {
 public:
@@ -18,15 +19,24 @@ public:
         bool json = false;
         bool show_namespaces = false;
         bool documentation = false;
+        bool store_documentation = true; // whether documentation comments are stored (not by clients of a server, which share the documentation)
         int max_search_depth = 5;
         int max_search_threads = 1;
+        int max_search_premises = 0;
+        int max_search_queries = 0; // 0 for no limit
+        bool trace = false; // whether the query trees of search results are logged, see `Searcher::set_trace`
+        std::string suspend_file; // file to which an interrupted proof is written, and from which it is resumed
+        const std::atomic<bool> *interrupt = nullptr; // when set, searches are interrupted and parsing stops (e.g. when the server stops)
+        bool imports = true; // whether files can be imported (not by clients of a server, which may not change the session)
     };
 
     Parser(std::istream &, std::ostream &, Session &, Options options);
+    Parser(Scanner, std::ostream &, Session &, Options options);
     Parser(const Parser &) = delete;
 
     void set_documentation(std::unordered_map<std::string, std::string> *);
     void set_location(std::string &, std::string &);
+    void set_request(const std::string &);
     bool parse();
 
 private:
@@ -37,6 +47,8 @@ private:
     std::string m_filename, m_directory;
     Token m_current_token = {NONE, std::string(), 0, 0};
     bool m_running = false;
+    std::string m_request; // when set, only declarations followed by a single statement of this kind are parsed, see `set_request`
+    bool m_request_parsed = false;
 
     // Namespace related fields
     Context *m_current_namespace;
@@ -52,6 +64,11 @@ private:
     // Searcher
     std::unique_ptr<Searcher> m_searcher;
 
+    // Paginated search, see `parse_search` and `parse_more`
+    std::unique_ptr<Context> m_page_context; // context of the parameters of the search
+    Telescope m_page_telescope;
+    int m_page_size = 0;
+
     // Token methods
     void next_token();
     bool found(TokenType);
@@ -70,6 +87,7 @@ private:
     void parse_structure();
     void parse_check();
     void parse_search();
+    void parse_more();
     void parse_prove();
 //    void parse_inspect();
     void parse_docs();
@@ -85,10 +103,16 @@ private:
     FunctionRef parse_term(Context &);
     Context *parse_absolute_namespace();
     std::unordered_set<Context *> parse_namespace_collection();
+    int parse_number();
     int parse_preference();
 
     // Util
     void setup_searcher();
+    void search_page(bool, int);
+    bool interrupted_search();
+    bool read_suspend_key(std::string &) const;
+    bool load_suspended_search(const FunctionRef &);
+    void suspend_search(const FunctionRef &);
 
     // Output methods
     void output(const std::string &);
@@ -4,32 +4,51 @@
 
 #include "Scanner.h"
 
-int Scanner::get_char() {
-    char c;
-    if (!m_istream.get(c))
-        return -1;
-
-    if (c == '\n') {
-        m_line++;
-        m_column = 0;
-    } else {
-        m_column++;
+Scanner::Scanner(std::istream &istream) : m_istream(&istream), m_interactive(istream.rdbuf() == std::cin.rdbuf()) {}
+
+Scanner::Scanner(std::string source) : m_istream(nullptr), m_interactive(false), m_buffer(std::move(source)) {}
+
+bool Scanner::fill() {
+    // Characters that are read already are discarded, but their lines and columns must be counted first
+    count();
+    m_buffer.clear();
+    m_offset = 0;
+    m_counted = 0;
+
+    if (m_istream == nullptr)
+        return false;
+    if (m_interactive) {
+        if (!std::getline(*m_istream, m_buffer))
+            return false;
+        if (!m_istream->eof())
+            m_buffer.push_back('\n');
+        return true;
     }
 
-    m_previous_char = m_current_char;
-    m_current_char = (unsigned char) c;
-
-    return c;
+    // Otherwise, read everything that is left at once
+    char chunk[1 << 16];
+    while (m_istream->read(chunk, sizeof(chunk)) || m_istream->gcount() > 0)
+        m_buffer.append(chunk, (size_t) m_istream->gcount());
+    return !m_buffer.empty();
 }
 
-int Scanner::get_previous_char() const {
-    return m_previous_char;
+void Scanner::count() const {
+    for (; m_counted < m_offset; ++m_counted) {
+        if (m_buffer[m_counted] == '\n') {
+            m_line++;
+            m_column = 0;
+        } else {
+            m_column++;
+        }
+    }
 }
 
 int Scanner::line() const {
+    count();
     return m_line;
 }
 
 int Scanner::position() const {
+    count();
     return m_column;
 }
@@ -7,20 +7,41 @@
 
 #include <istream>
 #include <iostream>
+#include <string>
 
+// Holds the characters that are read, either a whole file at once, or a single line when reading from stdin
+// (so that statements typed in the REPL are handled as soon as their line is complete). The buffer is exposed to the lexer
+// directly, and is only refilled once all characters in it are consumed. The line and column are only computed when asked for.
 class Scanner {
 
-    std::istream& m_istream;
+    std::istream *m_istream; // null when the whole source is given at once
+    const bool m_interactive;
 
-    int m_line = 1, m_column = 0;
-    int m_current_char = -1, m_previous_char = -1;
+    std::string m_buffer;
+    size_t m_offset = 0;
+
+    mutable size_t m_counted = 0; // offset in the buffer up to which the line and column are computed
+    mutable int m_line = 1, m_column = 0;
+
+    bool fill();
+    void count() const;
 
 public:
 
-    explicit Scanner(std::istream& istream) : m_istream(istream) {};
+    explicit Scanner(std::istream &istream);
+    explicit Scanner(std::string source);
+
+    // Returns the k-th character from the current one, or -1 if there is none. Only when all characters are consumed,
+    // `peek()` refills the buffer, so characters from `current()` up to `end()` stay valid until then.
+    int peek(size_t k = 0) {
+        if (m_offset + k < m_buffer.size())
+            return (unsigned char) m_buffer[m_offset + k];
+        return (k == 0 && fill()) ? (unsigned char) m_buffer[0] : -1;
+    }
 
-    int get_char();
-    int get_previous_char() const;
+    void advance(size_t n) { m_offset += n; }
+    const char *current() const { return m_buffer.data() + m_offset; }
+    const char *end() const { return m_buffer.data() + m_buffer.size(); }
 
     int line() const;
     int position() const;
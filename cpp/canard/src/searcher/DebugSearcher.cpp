@@ -9,7 +9,8 @@ DebugSearcher::DebugSearcher(std::shared_ptr<Query> query) {
 }
 
 bool DebugSearcher::apply(const FunctionRef &f) {
-    auto sub_query = Query::reduce(m_query, f);
+    Query::Workspace workspace;
+    auto sub_query = Query::reduce(m_query, f, workspace);
     if (sub_query == nullptr)
         return false;
 
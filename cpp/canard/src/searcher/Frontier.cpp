@@ -0,0 +1,127 @@
+#include "Frontier.h"
+#include <algorithm>
+#include <cstdint>
+
+template<typename F>
+void Frontier::for_each(std::vector<std::weak_ptr<Query>> &queries, F f) {
+    // Visit the queries that are still alive, and meanwhile remove those that are not
+    for (size_t i = 0; i < queries.size();) {
+        auto query = queries[i].lock();
+        if (query == nullptr) {
+            queries[i] = std::move(queries.back());
+            queries.pop_back();
+            --m_size;
+            continue;
+        }
+        if (!f(*query))
+            return;
+        ++i;
+    }
+}
+
+size_t Frontier::hash(const FunctionRef &f) {
+    // Mix the bits of the pointer, so that sums of hashes are spread out well
+    auto x = (uint64_t) std::hash<FunctionRef>()(f);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t) (x ^ (x >> 31));
+}
+
+size_t Frontier::hash(const Telescope &telescope) {
+    // The hash of a telescope is the sum of the hashes of its functions, so that it does not depend on the order
+    // of the functions, and so that the hash of a telescope with one function removed is easily computed
+    size_t h = 0;
+    for (const auto &f: telescope.functions())
+        h += hash(f);
+    return h;
+}
+
+bool Frontier::subsumes(const Query &p, const Query &q) {
+    // Queries of different branches are only comparable if p is easier than q, and the goals of p are not deeper
+    // than those of q, and their local context is at least as large. Otherwise, the search of p could be cut off
+    // at the maximum depth where the search of q would not be.
+    // Also, p must not be taken from the queue later than q would be, so that omitting q never delays the search.
+    if (&p == &q || p.complexity() > q.complexity() || !p.is_easier_than(q))
+        return false;
+
+    const auto &p_functions = p.telescope().functions();
+    const auto &q_functions = q.telescope().functions();
+    for (size_t i = 0, j = 0; i < p_functions.size(); ++i, ++j) {
+        while (q_functions[j] != p_functions[i])
+            ++j; // terminates since p is easier than q, so the functions of p are contained (in order) in those of q
+        if (p.depths()[i].depth > q.depths()[j].depth || p.depths()[i].locals_depth < q.depths()[j].locals_depth)
+            return false;
+    }
+    return true;
+}
+
+bool Frontier::is_subsumed(const Query &query) {
+    bool subsumed = false;
+    auto check = [&query, &subsumed](const Query &other) {
+        subsumed = subsumes(other, query);
+        return !subsumed;
+    };
+
+    // Look for queries with the same set of goals
+    const size_t h = hash(query.telescope());
+    auto it = m_by_telescope.find(h);
+    if (it != m_by_telescope.end())
+        for_each(it->second, check);
+
+    // Look for queries with one goal less
+    for (const auto &f: query.telescope().functions()) {
+        if (subsumed)
+            break;
+        it = m_by_telescope.find(h - hash(f));
+        if (it != m_by_telescope.end())
+            for_each(it->second, check);
+    }
+
+    return subsumed;
+}
+
+void Frontier::retire_subsumed_by(const Query &query) {
+    // Note: the query is queued after the known queries of the same complexity, so only those of a higher complexity are retired
+    auto retire = [&query](Query &other) {
+        if (!other.is_retired() && query.complexity() < other.complexity() && subsumes(query, other))
+            other.retire();
+        return true;
+    };
+
+    // Look for queries with the same set of goals
+    auto it = m_by_telescope.find(hash(query.telescope()));
+    if (it != m_by_telescope.end())
+        for_each(it->second, retire);
+}
+
+void Frontier::insert(const std::shared_ptr<Query> &query) {
+    m_by_telescope[hash(query->telescope())].emplace_back(query);
+    // Entries are otherwise only removed when their list is visited, so remove those of freed queries every now and then.
+    // Sweeping whenever the number of entries has doubled keeps this amortized constant per insertion.
+    if (++m_size >= m_sweep_size) {
+        sweep();
+        m_sweep_size = std::max(MIN_SWEEP_SIZE, 2 * m_size);
+    }
+}
+
+void Frontier::sweep() {
+    m_size = 0;
+    for (auto it = m_by_telescope.begin(); it != m_by_telescope.end();) {
+        auto &queries = it->second;
+        queries.erase(std::remove_if(queries.begin(), queries.end(), [](const std::weak_ptr<Query> &query) {
+            return query.expired();
+        }), queries.end());
+        if (queries.empty()) {
+            it = m_by_telescope.erase(it);
+            continue;
+        }
+        m_size += queries.size();
+        ++it;
+    }
+}
+
+void Frontier::clear() {
+    m_by_telescope.clear();
+    m_size = 0;
+    m_sweep_size = MIN_SWEEP_SIZE;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Query.h"
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+class Frontier {
+public:
+
+    bool is_subsumed(const Query &);
+    void retire_subsumed_by(const Query &);
+    void insert(const std::shared_ptr<Query> &);
+    void clear();
+
+private:
+
+    static const size_t MIN_SWEEP_SIZE = 1024; // number of entries before the first sweep
+
+    // Queries are stored by a hash of their set of goals. Only weak references are kept,
+    // so that queries which are exhausted can be freed as usual.
+    std::unordered_map<size_t, std::vector<std::weak_ptr<Query>>> m_by_telescope;
+    size_t m_size = 0; // number of entries, including those of queries that were freed already
+    size_t m_sweep_size = MIN_SWEEP_SIZE; // number of entries at which the entries of freed queries are removed
+
+    void sweep();
+
+    static size_t hash(const FunctionRef &);
+    static size_t hash(const Telescope &);
+    static bool subsumes(const Query &, const Query &);
+
+    template<typename F>
+    void for_each(std::vector<std::weak_ptr<Query>> &, F);
+
+};
@@ -5,65 +5,197 @@
 #include "Index.h"
 #include "../core/macros.h"
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
-struct TheoremEntry {
-    FunctionRef thm;
-    int preference;
+bool has_higher_preference(const Index::Theorem &a, const Index::Theorem &b) {
+    return a.preference > b.preference;
+}
 
-    bool operator<(const TheoremEntry &other) const {
-        return preference > other.preference;
-    }
-};
-
-std::vector<FunctionRef> sort_and_convert(std::vector<TheoremEntry> &input) {
-    std::vector<FunctionRef> output;
-    output.reserve(input.size());
-    std::sort(input.begin(), input.end());
-    for (const auto &entry: input)
-        output.push_back(entry.thm);
-    return output;
+std::vector<Context *> in_order(const std::unordered_set<Context *> &spaces) {
+    // The namespaces in an order that does not depend on where they are in memory, so that the theorems are indexed
+    // in the same order whether the session was parsed or loaded from a snapshot (forks come after their namespace)
+    std::vector<Context *> ordered(spaces.begin(), spaces.end());
+    std::sort(ordered.begin(), ordered.end(), [](const Context *a, const Context *b) {
+        if (a->full_name() != b->full_name())
+            return a->full_name() < b->full_name();
+        return a->base() == nullptr && b->base() != nullptr;
+    });
+    return ordered;
 }
 
-Index::Index(const std::unordered_set<Context *> &spaces) {
-    std::vector<TheoremEntry> all_theorems, generic_theorems;
-    std::unordered_map<FunctionRef, std::vector<TheoremEntry>> index;
+template<typename F>
+void parallel_for(size_t n, int threads, F f) {
+    // Calls f(0), ..., f(n - 1), distributed over the given number of threads
+    if (threads <= 1 || n <= 1) {
+        for (size_t i = 0; i < n; ++i)
+            f(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    auto work = [&next, n, &f]() {
+        for (size_t i; (i = next++) < n;)
+            f(i);
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads && (size_t) t < n; ++t)
+        pool.emplace_back(work);
+    work();
+    for (auto &thread: pool)
+        thread.join();
+}
 
+Index::Index(const std::unordered_set<Context *> &spaces, const int threads) {
     // Make a list of lists of all functions that can be used during the search
     // We do this in advance so that we don't constantly create new arraylists
-    for (const auto space: spaces) {
-        all_theorems.reserve(all_theorems.size() + space->functions().size());
-        for (const auto &entry: space->functions()) {
-            const auto &thm = entry.second;
-            const auto &thm_type_base = thm.type().base();
-            const int preference = space->get_preference(thm);
-
-            all_theorems.push_back({thm, preference});
-
-            // If thm.type().base() is a parameter of the theorem, then store in the 'general' category
-            if (thm->parameters().contains(thm_type_base)) {
-                generic_theorems.push_back({thm, preference});
-                continue;
-            }
-
-            auto it = index.find(thm_type_base);
-            if (it != index.end()) {
-                it->second.push_back({thm, preference});
-                continue;
-            }
-
-            // Alternatively, create a new entry in the index
-            index.emplace(thm_type_base, std::vector<TheoremEntry>({{thm, preference}}));
+    // The functions are taken in the order in which they were put, as in `update`
+    std::vector<std::pair<Context *, const FunctionRef *>> entries;
+    for (const auto space: in_order(spaces)) {
+        for (const auto &f: space->history())
+            entries.emplace_back(space, &f);
+        m_spaces.emplace(space, space->history().size());
+    }
+
+    // Compiling the theorems is independent for every function, so it is done in parallel
+    m_all_theorems = std::make_shared<std::vector<Theorem>>(entries.size());
+    m_generic_theorems = std::make_shared<std::vector<Theorem>>();
+    auto &all_theorems = *m_all_theorems;
+    parallel_for(entries.size(), threads, [&all_theorems, &entries](size_t i) {
+        const auto space = entries[i].first;
+        const auto &f = *entries[i].second;
+        all_theorems[i] = {f, std::make_shared<const MatchProgram>(f), space, space->get_preference(f), symbols(f), dependencies(f)};
+    });
+
+    for (const auto &thm: all_theorems) {
+        // If thm.type().base() is a parameter of the theorem, then store in the 'general' category
+        const auto &thm_type_base = thm.function.type().base();
+        if (thm.function->parameters().contains(thm_type_base)) {
+            m_generic_theorems->push_back(thm);
+            continue;
         }
+
+        auto &list = m_index[thm_type_base];
+        if (list == nullptr)
+            list = std::make_shared<std::vector<Theorem>>();
+        list->push_back(thm);
+    }
+
+    // Sort by preference. The lists are sorted independently (largest first, for a better distribution
+    // over the threads), and each list is sorted exactly as it would be sequentially.
+    std::vector<std::vector<Theorem> *> lists = {m_all_theorems.get(), m_generic_theorems.get()};
+    for (auto &entry: m_index)
+        lists.push_back(entry.second.get());
+    std::sort(lists.begin(), lists.end(), [](const std::vector<Theorem> *a, const std::vector<Theorem> *b) {
+        return a->size() > b->size();
+    });
+    parallel_for(lists.size(), threads, [&lists](size_t i) {
+        std::stable_sort(lists[i]->begin(), lists[i]->end(), has_higher_preference);
+    });
+}
+
+std::vector<Index::Theorem> &Index::own(List &list) {
+    // Lists that are shared with other indices are copied before they are changed. Note: a list that is not shared
+    // can only be reached through this index, which is not yet shared itself while it is changed.
+    if (list.use_count() > 1)
+        list = std::make_shared<std::vector<Theorem>>(*list);
+    return *list;
+}
+
+bool Index::update(const std::unordered_set<Context *> &spaces) {
+    // Remove the namespaces that are no longer used
+    std::unordered_set<Context *> removed;
+    for (const auto &entry: m_spaces) {
+        if (!spaces.count(entry.first))
+            removed.insert(entry.first);
+    }
+    if (!removed.empty())
+        remove(removed);
+
+    // Add the functions that were put in the namespaces since they were indexed (or all of them, for new namespaces)
+    std::vector<std::vector<Theorem> *> changed;
+    for (const auto space: in_order(spaces)) {
+        size_t &count = m_spaces[space];
+        const auto &history = space->history();
+        for (; count < history.size(); ++count)
+            add(space, history[count], changed);
     }
 
-    // Sort and copy
-    m_all_theorems = sort_and_convert(all_theorems);
-    m_generic_theorems = sort_and_convert(generic_theorems);
-    for (auto &entry: index)
-        m_index.emplace(entry.first, sort_and_convert(entry.second));
+    // Restore the order of the lists that changed. The sort is stable, so new theorems are placed after
+    // existing theorems of the same preference.
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    for (auto list: changed)
+        std::stable_sort(list->begin(), list->end(), has_higher_preference);
+
+    return !removed.empty() || !changed.empty();
+}
+
+void Index::add(Context *space, const FunctionRef &f, std::vector<std::vector<Theorem> *> &changed) {
+    const auto &thm_type_base = f.type().base();
+    const Theorem thm = {f, std::make_shared<const MatchProgram>(f), space, space->get_preference(f), symbols(f), dependencies(f)};
+
+    auto &all_theorems = own(m_all_theorems);
+    all_theorems.push_back(thm);
+    changed.push_back(&all_theorems);
+
+    auto &list_ref = f->parameters().contains(thm_type_base) ? m_generic_theorems : m_index[thm_type_base];
+    if (list_ref == nullptr)
+        list_ref = std::make_shared<std::vector<Theorem>>();
+    auto &list = own(list_ref);
+    list.push_back(thm);
+    changed.push_back(&list);
+}
+
+void Index::remove(const std::unordered_set<Context *> &spaces) {
+    auto from = [&spaces](const Theorem &thm) { return spaces.count(thm.space) > 0; };
+    auto remove_from = [&from](List &list) {
+        if (std::any_of(list->begin(), list->end(), from)) {
+            auto &own_list = own(list);
+            own_list.erase(std::remove_if(own_list.begin(), own_list.end(), from), own_list.end());
+        }
+    };
+    remove_from(m_all_theorems);
+    remove_from(m_generic_theorems);
+    for (auto it = m_index.begin(); it != m_index.end();) {
+        remove_from(it->second);
+        it = it->second->empty() ? m_index.erase(it) : std::next(it);
+    }
+    for (const auto space: spaces)
+        m_spaces.erase(space);
 }
 
-const std::vector<FunctionRef> *Index::theorems(const FunctionRef &f) const {
+const std::vector<Index::Theorem> *Index::theorems(const FunctionRef &f) const {
     auto it = m_index.find(f);
-    return (it != m_index.end()) ? &it->second : nullptr;
+    return (it != m_index.end()) ? it->second.get() : nullptr;
+}
+
+void collect_symbols(const FunctionRef &f, const std::vector<FunctionRef> &bound, uint64_t &symbols) {
+    if (f->is_base()) {
+        if (std::find(bound.begin(), bound.end(), f) == bound.end())
+            symbols |= Query::fingerprint(f);
+        return;
+    }
+    collect_symbols(f.base(), bound, symbols);
+    for (const auto &argument: f->arguments())
+        collect_symbols(argument, bound, symbols);
+}
+
+uint64_t Index::symbols(const FunctionRef &f) {
+    // One bit per (hash of a) function occurring in the types of f and its parameters, except for the parameters themselves
+    uint64_t symbols = 0;
+    const auto &parameters = f->parameters().functions();
+    for (const auto &parameter: parameters)
+        collect_symbols(parameter.type(), parameters, symbols);
+    collect_symbols(f.type(), parameters, symbols);
+    return symbols;
+}
+
+uint64_t Index::dependencies(const FunctionRef &f) {
+    // One bit per (hash of a) base function of which f is composed, i.e. those on which f may depend (see `FunctionRef::depends_on`)
+    if (f->is_base())
+        return Query::fingerprint(f);
+    uint64_t dependencies = Index::dependencies(f.base());
+    for (const auto &argument: f->arguments())
+        dependencies |= Index::dependencies(argument);
+    return dependencies;
 }
@@ -5,21 +5,52 @@
 #pragma once
 
 #include "../data/Context.h"
+#include "MatchProgram.h"
+#include "Query.h"
 #include <unordered_set>
+#include <memory>
 #include <vector>
+#include <cstdint>
 
 class Index {
 public:
 
-    explicit Index(const std::unordered_set<Context *> &);
+    struct Theorem {
+        FunctionRef function;
+        std::shared_ptr<const MatchProgram> program; // compiled type of the theorem (to rule it out quickly), shared between the lists
+        Context *space; // namespace from which the theorem was indexed
+        int preference;
+        uint64_t symbols; // fingerprint of the functions occurring in the theorem, see `symbols`
+        uint64_t dependencies; // fingerprint of the base functions the theorem is composed of, see `dependencies`
+
+        bool depends_on(const FunctionRef &f) const {
+            // Note: f is a base function, so most theorems are ruled out by their fingerprint only
+            return (dependencies & Query::fingerprint(f)) != 0 && function.depends_on({f});
+        }
+    };
+
+    explicit Index(const std::unordered_set<Context *> &, int = 1);
+    Index(const Index &) = default;
+
+    bool update(const std::unordered_set<Context *> &);
+
+    const std::vector<Theorem> &all_theorems() const { return *m_all_theorems; }
+    const std::vector<Theorem> &generic_theorems() const { return *m_generic_theorems; }
+    const std::vector<Theorem> *theorems(const FunctionRef &) const;
+
+    static uint64_t symbols(const FunctionRef &);
+    static uint64_t dependencies(const FunctionRef &);
 
-    const std::vector<FunctionRef> &all_theorems() const { return m_all_theorems; }
-    const std::vector<FunctionRef> &generic_theorems() const { return m_generic_theorems; }
-    const std::vector<FunctionRef> *theorems(const FunctionRef &) const;
-    
 private:
 
-    std::vector<FunctionRef> m_all_theorems, m_generic_theorems;
-    std::unordered_map<FunctionRef, std::vector<FunctionRef>> m_index;
+    // The lists are shared between copies of the index, and only copied once they are changed (see `own`)
+    typedef std::shared_ptr<std::vector<Theorem>> List;
+    List m_all_theorems, m_generic_theorems;
+    std::unordered_map<FunctionRef, List> m_index;
+    std::unordered_map<Context *, size_t> m_spaces; // indexed namespaces, with the number of their functions that are indexed
+
+    void add(Context *, const FunctionRef &, std::vector<std::vector<Theorem> *> &);
+    void remove(const std::unordered_set<Context *> &);
+    static std::vector<Theorem> &own(List &);
 
 };
@@ -0,0 +1,54 @@
+#include "Locals.h"
+#include "Query.h"
+#include <algorithm>
+
+uint64_t compute_fingerprint(const std::vector<FunctionRef> &functions) {
+    uint64_t fingerprint = 0;
+    for (const auto &f: functions) {
+        if (f != nullptr)
+            fingerprint |= Query::fingerprint(f);
+    }
+    return fingerprint;
+}
+
+std::vector<FunctionRef> compute_heads(const std::vector<FunctionRef> &functions) {
+    std::vector<FunctionRef> heads;
+    heads.reserve(functions.size());
+    for (const auto &f: functions) {
+        const auto &head = f.type().base();
+        heads.push_back(f->parameters().contains(head) ? nullptr : head);
+    }
+    return heads;
+}
+
+Locals::Layer::Layer(std::vector<FunctionRef> functions) : functions(std::move(functions)),
+                                                           fingerprint(compute_fingerprint(this->functions)),
+                                                           heads(compute_heads(this->functions)),
+                                                           heads_fingerprint(compute_fingerprint(heads)),
+                                                           has_generic(std::find(heads.begin(), heads.end(), nullptr) != heads.end()) {}
+
+uint64_t Locals::fingerprint() const {
+    uint64_t fingerprint = 0;
+    for (const auto &layer: m_layers)
+        fingerprint |= layer->fingerprint;
+    return fingerprint;
+}
+
+void Locals::push(std::vector<FunctionRef> functions) {
+    m_layers.push_back(std::make_shared<const Layer>(std::move(functions)));
+}
+
+void Locals::push(std::shared_ptr<const Layer> layer) {
+    m_layers.push_back(std::move(layer));
+}
+
+void Locals::set(size_t i, const std::vector<FunctionRef> &functions) {
+    // Only replace the layer if it actually changes, so that it stays shared otherwise
+    if (m_layers[i]->functions != functions)
+        m_layers[i] = std::make_shared<const Layer>(functions);
+}
+
+void Locals::truncate(size_t n) {
+    if (n < m_layers.size())
+        m_layers.erase(m_layers.begin() + (long) n, m_layers.end());
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../core/Function.h"
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <iterator>
+
+class Locals {
+public:
+
+    struct Layer {
+        explicit Layer(std::vector<FunctionRef>);
+
+        const std::vector<FunctionRef> functions;
+        const uint64_t fingerprint; // one bit per (hash of a) function in the layer
+        const std::vector<FunctionRef> heads; // for every function the base of its type, or null if that is one of its parameters
+        const uint64_t heads_fingerprint; // one bit per (hash of a) non-null head
+        const bool has_generic; // whether some head is null
+    };
+
+    class const_iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::vector<FunctionRef> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type *pointer;
+        typedef const value_type &reference;
+
+        explicit const_iterator(std::vector<std::shared_ptr<const Layer>>::const_iterator it) : m_it(it) {}
+
+        const std::vector<FunctionRef> &operator*() const { return (*m_it)->functions; }
+        const std::vector<FunctionRef> *operator->() const { return &(*m_it)->functions; }
+        const_iterator &operator++() { ++m_it; return *this; }
+        bool operator==(const const_iterator &other) const { return m_it == other.m_it; }
+        bool operator!=(const const_iterator &other) const { return m_it != other.m_it; }
+
+    private:
+        std::vector<std::shared_ptr<const Layer>>::const_iterator m_it;
+    };
+
+    size_t size() const { return m_layers.size(); }
+    bool empty() const { return m_layers.empty(); }
+    const std::vector<FunctionRef> &operator[](size_t i) const { return m_layers[i]->functions; }
+    const Layer &layer(size_t i) const { return *m_layers[i]; }
+    const std::shared_ptr<const Layer> &shared_layer(size_t i) const { return m_layers[i]; }
+    uint64_t fingerprint(size_t i) const { return m_layers[i]->fingerprint; }
+    uint64_t fingerprint() const;
+
+    const_iterator begin() const { return const_iterator(m_layers.begin()); }
+    const_iterator end() const { return const_iterator(m_layers.end()); }
+
+    void push(std::vector<FunctionRef>);
+    void push(std::shared_ptr<const Layer>);
+    void set(size_t, const std::vector<FunctionRef> &);
+    void truncate(size_t);
+
+private:
+
+    // Layers are immutable, so that they can be shared between a query and its sub-queries
+    std::vector<std::shared_ptr<const Layer>> m_layers;
+
+};
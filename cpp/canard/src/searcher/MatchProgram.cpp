@@ -0,0 +1,126 @@
+#include "MatchProgram.h"
+#include <algorithm>
+
+const int MAY_MATCH_DEPTH = 3; // depth up to which `may_match` compares arguments
+
+bool is_indeterminate(const FunctionRef &f, const std::vector<FunctionRef> &telescope, const std::vector<FunctionRef> &thm_parameters) {
+    return f->is_base() &&
+           (std::find(telescope.begin(), telescope.end(), f) != telescope.end() ||
+            std::find(thm_parameters.begin(), thm_parameters.end(), f) != thm_parameters.end());
+}
+
+MatchProgram::MatchProgram(const FunctionRef &thm) : m_parameters(thm->parameters().size()) {
+    compile(thm.type(), thm->parameters().functions());
+}
+
+void MatchProgram::compile(const FunctionRef &f, const std::vector<FunctionRef> &thm_parameters) {
+    // The instructions are in pre-order, and each instruction knows where the instructions of its expression end
+    const size_t position = m_instructions.size();
+    m_instructions.push_back({SKIP, 0, (uint16_t) f->parameters().size(), 0, f});
+    if (f->parameters().empty()) {
+        const auto &f_base = f.base();
+        auto it = std::find(thm_parameters.begin(), thm_parameters.end(), f_base);
+        if (it == thm_parameters.end()) {
+            m_instructions[position].opcode = RIGID;
+            m_instructions[position].index = (uint16_t) f->arguments().size();
+            for (const auto &argument: f->arguments())
+                compile(argument, thm_parameters);
+        } else if (f->is_base()) {
+            m_instructions[position].opcode = BIND;
+            m_instructions[position].index = (uint16_t) std::distance(thm_parameters.begin(), it);
+        }
+        // Note: parameters of the theorem with arguments are higher-order, and are left to the matcher
+    }
+    m_instructions[position].end = (uint32_t) m_instructions.size();
+}
+
+bool MatchProgram::run(const FunctionRef &goal_type, const std::vector<FunctionRef> &telescope, Registers &registers) const {
+    // Returns false only if `Matcher::matches(goal_type, thm.type())` certainly fails, where the indeterminates
+    // of the matcher are the functions of the telescope and the parameters of the theorem
+    static const std::vector<FunctionRef> no_parameters;
+    auto &stack = registers.stack;
+    auto &bindings = registers.bindings;
+    stack.clear();
+    stack.push_back(&goal_type);
+    bindings.assign(m_parameters, nullptr);
+
+    for (size_t pc = 0; pc < m_instructions.size();) {
+        const auto &instruction = m_instructions[pc];
+        const FunctionRef &f = *stack.back();
+        stack.pop_back();
+
+        // Identical expressions match, and otherwise the number of parameters must agree
+        if (f == instruction.expression) {
+            pc = instruction.end;
+            continue;
+        }
+        if (f->parameters().size() != instruction.parameters)
+            return false;
+
+        switch (instruction.opcode) {
+            case RIGID: {
+                // Different bases can only match if the base of f is an indeterminate
+                const auto &f_base = f.base();
+                if (f_base != instruction.expression.base()) {
+                    if (std::find(telescope.begin(), telescope.end(), f_base) == telescope.end())
+                        return false;
+                    pc = instruction.end;
+                    continue;
+                }
+                const auto &arguments = f->arguments();
+                if (arguments.size() != instruction.index) {
+                    pc = instruction.end;
+                    continue;
+                }
+                for (auto it = arguments.rbegin(); it != arguments.rend(); ++it)
+                    stack.push_back(&*it);
+                ++pc;
+                continue;
+            }
+            case BIND: {
+                // If the parameter was bound before, the two expressions it was bound to must match as well
+                auto &binding = bindings[instruction.index];
+                if (binding == nullptr)
+                    binding = &f;
+                else if (!may_match(*binding, f, telescope, no_parameters, MAY_MATCH_DEPTH))
+                    return false;
+                pc = instruction.end;
+                continue;
+            }
+            case SKIP:
+                pc = instruction.end;
+                continue;
+        }
+    }
+    return true;
+}
+
+bool MatchProgram::may_match(const FunctionRef &f, const FunctionRef &g,
+                             const std::vector<FunctionRef> &telescope, const std::vector<FunctionRef> &thm_parameters) {
+    return may_match(f, g, telescope, thm_parameters, MAY_MATCH_DEPTH);
+}
+
+bool MatchProgram::may_match(const FunctionRef &f, const FunctionRef &g,
+                             const std::vector<FunctionRef> &telescope, const std::vector<FunctionRef> &thm_parameters, const int depth) {
+    // A necessary condition for `Matcher::matches(f, g)` which does not allocate: the number of parameters must agree,
+    // and rigid bases must agree (recursively in the arguments, up to the given depth). Cases with parameters are not inspected,
+    // since parameters become indeterminates themselves.
+    if (f == g)
+        return true;
+    if (f->parameters().size() != g->parameters().size())
+        return false;
+    if (!f->parameters().empty() || depth == 0)
+        return true;
+    // Note: for base functions, the base is the function itself, so this also covers f or g being an indeterminate
+    const auto &f_base = f.base(), &g_base = g.base();
+    if (f_base != g_base)
+        return is_indeterminate(f_base, telescope, thm_parameters) || is_indeterminate(g_base, telescope, thm_parameters);
+    const auto &f_arguments = f->arguments(), &g_arguments = g->arguments();
+    if (f_arguments.size() != g_arguments.size())
+        return true;
+    for (size_t i = 0; i < f_arguments.size(); ++i) {
+        if (!may_match(f_arguments[i], g_arguments[i], telescope, thm_parameters, depth - 1))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../core/Function.h"
+#include <vector>
+#include <cstdint>
+
+// The type of a theorem, compiled into a flat sequence of instructions which is run against the type of a goal.
+// It only rejects the theorems that certainly do not apply to the goal, and does not produce the bindings: the theorems
+// that pass are matched by the `Matcher` as before, which also matches the types of the bound parameters.
+class MatchProgram {
+public:
+
+    explicit MatchProgram(const FunctionRef &);
+
+    // Buffers used by `run`, which are reused between calls
+    struct Registers {
+        std::vector<const FunctionRef *> stack; // sub-expressions of the goal type which are still to be matched
+        std::vector<const FunctionRef *> bindings; // for each parameter of the theorem, the sub-expression it is bound to
+    };
+
+    bool run(const FunctionRef &, const std::vector<FunctionRef> &, Registers &) const;
+
+    static bool may_match(const FunctionRef &, const FunctionRef &, const std::vector<FunctionRef> &, const std::vector<FunctionRef> &);
+
+private:
+
+    enum Opcode : uint8_t {
+        RIGID, // the goal must have the same base (and number of arguments), then match the arguments
+        BIND, // bind the goal to a parameter of the theorem
+        SKIP // cannot be judged without the matcher (e.g. parameters, or parameters of the theorem with arguments)
+    };
+
+    struct Instruction {
+        Opcode opcode;
+        uint16_t index; // RIGID: number of arguments, BIND: index of the parameter of the theorem
+        uint16_t parameters; // number of parameters of the expression
+        uint32_t end; // index of the instruction after the instructions of this expression
+        FunctionRef expression;
+    };
+
+    const size_t m_parameters; // number of parameters of the theorem
+    std::vector<Instruction> m_instructions;
+
+    void compile(const FunctionRef &, const std::vector<FunctionRef> &);
+
+    static bool may_match(const FunctionRef &, const FunctionRef &, const std::vector<FunctionRef> &, const std::vector<FunctionRef> &, int);
+
+};
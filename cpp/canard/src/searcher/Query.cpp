@@ -10,37 +10,66 @@
 #include <algorithm>
 #include <numeric>
 
-int max(const std::vector<int> &vector) {
+int max_locals_depth(const std::vector<Query::Depths> &depths) {
     int max = 0;
-    for (const int &x: vector) {
-        if (x > max)
-            max = x;
+    for (const auto &d: depths) {
+        if (d.locals_depth > max)
+            max = d.locals_depth;
     }
     return max;
 }
 
 Query::Query(Telescope telescope) :
         m_parent(nullptr),
+        m_trace(new Trace{nullptr, nullptr, {}, telescope.functions()}),
         m_telescope(std::move(telescope)),
-        m_depths(m_telescope.size(), 0),
-        m_locals_depths(m_telescope.size(), 0),
+        m_depths(m_telescope.size(), {0, 0}),
         m_depth(compute_depth()),
-        m_complexity(compute_complexity()) {}
+        m_complexity(compute_complexity()),
+        m_telescope_fingerprint(compute_telescope_fingerprint()),
+        m_locals_fingerprint(m_locals.fingerprint()),
+        m_parents_telescope_fingerprint(~(uint64_t) 0),
+        m_parents_locals_fingerprint(0),
+        m_id(next_id()) {}
 
 Query::Query(std::shared_ptr<Query> parent,
              Telescope telescope,
-             std::vector<int> depths,
-             std::vector<std::vector<FunctionRef>> locals,
-             std::vector<int> locals_depths,
-             std::unordered_map<FunctionRef, FunctionRef> solutions)
+             std::vector<Depths> depths,
+             Locals locals,
+             Solutions solutions)
         : m_parent(std::move(parent)),
+          m_trace(new Trace{m_parent->m_trace, m_parent->goal(), std::move(solutions), {}}),
           m_telescope(std::move(telescope)),
           m_depths(std::move(depths)),
           m_locals(std::move(locals)),
-          m_locals_depths(std::move(locals_depths)),
-          m_solutions(std::move(solutions)),
           m_depth(compute_depth()),
-          m_complexity(compute_complexity()) {}
+          m_complexity(compute_complexity()),
+          m_telescope_fingerprint(compute_telescope_fingerprint()),
+          m_locals_fingerprint(m_locals.fingerprint()),
+          m_parents_telescope_fingerprint(m_parent->m_parents_telescope_fingerprint & m_parent->m_telescope_fingerprint),
+          m_parents_locals_fingerprint(m_parent->m_parents_locals_fingerprint | m_parent->m_locals_fingerprint),
+          m_id(next_id()) {}
+
+Query::Query(std::shared_ptr<Query> parent,
+             std::shared_ptr<const Trace> trace,
+             Telescope telescope,
+             std::vector<Depths> depths,
+             Locals locals)
+        : m_parent(std::move(parent)),
+          m_trace(std::move(trace)),
+          m_telescope(std::move(telescope)),
+          m_depths(std::move(depths)),
+          m_locals(std::move(locals)),
+          m_depth(compute_depth()),
+          m_complexity(compute_complexity()),
+          m_telescope_fingerprint(compute_telescope_fingerprint()),
+          m_locals_fingerprint(m_locals.fingerprint()),
+          // Note: if the parent was released, the fingerprints of the parents are unknown, so nothing is ruled out
+          m_parents_telescope_fingerprint(m_parent ? m_parent->m_parents_telescope_fingerprint & m_parent->m_telescope_fingerprint
+                                                   : (m_trace->parent ? 0 : ~(uint64_t) 0)),
+          m_parents_locals_fingerprint(m_parent ? m_parent->m_parents_locals_fingerprint | m_parent->m_locals_fingerprint
+                                                : (m_trace->parent ? ~(uint64_t) 0 : 0)),
+          m_id(next_id()) {}
 
 std::shared_ptr<Query> Query::normalize(const std::shared_ptr<Query> &query) {
     // Get goal
@@ -56,37 +85,44 @@ std::shared_ptr<Query> Query::normalize(const std::shared_ptr<Query> &query) {
     auto new_h = Function::make({}, h.type());
     new_functions[h_index] = new_h;
 
-    // Add a layer of local functions given by the parameters of h
-    std::vector<std::vector<FunctionRef>> new_locals = query->m_locals;
-    new_locals.push_back(h->parameters().functions());
+    // Add a layer of local functions given by the parameters of h (the other layers are shared with query)
+    Locals new_locals = query->m_locals;
+    new_locals.push(h->parameters().functions());
 
-    std::vector<int> new_locals_depths = query->m_locals_depths;
-    new_locals_depths[h_index]++; // increase locals depth of new_h by one
+    // Use the same depths, seems fair, but increase locals depth of new_h by one
+    std::vector<Depths> new_depths = query->m_depths;
+    new_depths[h_index].locals_depth++;
 
     std::shared_ptr<Query> sub_query(new Query(
             query,
             Telescope(new_functions),
-            query->m_depths, // use the same depths, seems fair
+            std::move(new_depths),
             std::move(new_locals),
-            std::move(new_locals_depths),
             {{h, new_h}} // note: parameters don't agree, but that is fixed in final_solutions method
     ));
 
     return sub_query;
 }
 
-std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const FunctionRef &thm) {
+std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const FunctionRef &thm, Workspace &workspace,
+                                     const MatchProgram *program) {
     // Get goal
     int h_index;
     const auto &h = query->goal(&h_index);
     // At this point, h is asserted to have no parameters!
     CANARD_ASSERT(h->parameters().empty(), "h cannot have parameters");
-    CANARD_ASSERT(query->m_locals_depths[h_index] == query->m_locals.size(), "h should have maximal context depth");
+    CANARD_ASSERT(query->m_depths[h_index].locals_depth == query->m_locals.size(), "h should have maximal context depth");
 
     // Create matcher with indeterminates from both telescope and thm parameters
+    // But first rule out the (many) theorems that clearly do not apply, before anything is allocated,
+    // using the compiled program of thm if it is available
     const auto &telescope = query->telescope().functions();
     const auto &thm_parameters = thm->parameters().functions();
-    std::vector<FunctionRef> indeterminates_total = telescope;
+    if (program != nullptr ? !program->run(h.type(), telescope, workspace.registers)
+                           : !MatchProgram::may_match(h.type(), thm.type(), telescope, thm_parameters))
+        return nullptr;
+    auto &indeterminates_total = workspace.indeterminates_total;
+    indeterminates_total.assign(telescope.begin(), telescope.end());
     indeterminates_total.insert(indeterminates_total.end(), thm_parameters.begin(), thm_parameters.end());
     Matcher matcher(indeterminates_total);
 
@@ -97,24 +133,29 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
 
     // Create the new sub_query, and keep track of the solutions (for telescope) and the arguments (for thm)
     // and the new telescope (for the sub_query)
-    std::vector<FunctionRef> new_indeterminates;
-    auto max_indeterminates = telescope.size() - 1 + thm_parameters.size(); // maximum number of new indeterminates: prioritize speed over memory
-    new_indeterminates.reserve(max_indeterminates);
-    std::unordered_map<FunctionRef, FunctionRef> new_solutions;
-    std::vector<int> new_depths, new_locals_depths;
-    new_depths.reserve(max_indeterminates);
-    new_locals_depths.reserve(max_indeterminates);
-    std::vector<FunctionRef> thm_arguments(thm_parameters.size());
-    std::vector<std::vector<FunctionRef>> new_locals(query->m_locals.size());
-    int locals_size = 0;
-    for (int i = 0; i < query->m_locals.size(); ++i) {
-        int size = (int) query->m_locals[i].size();
-        new_locals[i].reserve(size);
-        locals_size += size;
+    // Note: the buffers of the workspace are only copied (to their actual size) when the sub_query is created
+    auto &new_indeterminates = workspace.new_indeterminates;
+    new_indeterminates.clear();
+    auto &new_solutions = workspace.new_solutions;
+    new_solutions.clear();
+    auto &new_depths = workspace.new_depths;
+    new_depths.clear();
+    auto &thm_arguments = workspace.thm_arguments;
+    thm_arguments.assign(thm_parameters.size(), nullptr);
+    const int locals_count = (int) query->m_locals.size();
+    auto &new_locals = workspace.new_locals;
+    auto &unmapped_locals = workspace.unmapped_locals;
+    if ((int) new_locals.size() < locals_count) {
+        new_locals.resize(locals_count);
+        unmapped_locals.resize(locals_count);
+    }
+    for (int i = 0; i < locals_count; ++i) {
+        new_locals[i].clear();
+        unmapped_locals[i].assign(query->m_locals[i].begin(), query->m_locals[i].end());
     }
 
-    const int h_depth = query->m_depths[h_index];
-    const int h_context_depth = query->m_locals_depths[h_index];
+    const int h_depth = query->m_depths[h_index].depth;
+    const int h_context_depth = query->m_depths[h_index].locals_depth;
 
     // Local functions, telescope functions and thm parameters can all depend on one another, so they must be carefully mapped to the new query.
     // Let `mappable_old` be all of these functions (except for h, it will be treated later on).
@@ -125,13 +166,12 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
     //  - we first insert local functions (as rather have that something has a local function as solution than the other way around)
     //  - we keep track of context depth, it should be non-decreasing along the way
     //  - the order (1) local functions, (2) telescope functions, (3) thm parameters is important!
-    std::vector<FunctionRef> mappable;
-    mappable.reserve(telescope.size() - 1 + thm_parameters.size() + locals_size);
-    std::vector<std::vector<FunctionRef>> unmapped_locals = query->m_locals;
-    std::vector<int> unmapped_telescope_indices;
-    unmapped_telescope_indices.reserve(telescope.size() - 1);
-    std::vector<int> unmapped_thm_parameter_indices;
-    unmapped_thm_parameter_indices.reserve(thm_parameters.size());
+    auto &mappable = workspace.mappable;
+    mappable.clear();
+    auto &unmapped_telescope_indices = workspace.unmapped_telescope_indices;
+    unmapped_telescope_indices.clear();
+    auto &unmapped_thm_parameter_indices = workspace.unmapped_thm_parameter_indices;
+    unmapped_thm_parameter_indices.clear();
     for (const auto &locals: query->m_locals)
         mappable.insert(mappable.end(), locals.begin(), locals.end()); // locals might need mapping too
     for (int i = 0; i < telescope.size(); ++i) {
@@ -152,15 +192,16 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
     Matcher query_to_sub_query(mappable);
 
     // Create sets of unmapped functions and infected functions. We choose sets because we want to check membership fast.
-    std::vector<FunctionRef> unmapped = mappable;
-    std::vector<FunctionRef> infected; // indicates which functions have a (non-trivial) solution
-    infected.reserve(mappable.size());
+    auto &unmapped = workspace.unmapped;
+    unmapped.assign(mappable.begin(), mappable.end());
+    auto &infected = workspace.infected; // indicates which functions have a (non-trivial) solution
+    infected.clear();
 
     int locals_depth_tracker = 0; // the way in which the mappable are resolved must be w.r.t. non-decreasing locals depth, as otherwise there are non-allowed solutions
 
     while (!unmapped.empty()) {
         // (1) Local functions
-        for (int depth = 0; depth < unmapped_locals.size(); ++depth) {
+        for (int depth = 0; depth < locals_count; ++depth) {
             auto &vector = unmapped_locals[depth];
             for (auto it = vector.begin(); it != vector.end(); ++it) {
                 const auto &f = *it;
@@ -175,7 +216,7 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
                 // ... and if so, match, set solution, and mark as infected
                 if (g != f) {
                     query_to_sub_query.assert_matches(f, g);
-                    new_solutions.emplace(f, g);
+                    new_solutions.emplace_back(f, g);
                     infected.push_back(f);
                 }
 
@@ -197,7 +238,7 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
                     continue;
 
                 // Check if `f_solution` is defined in the local context of f
-                const int f_context_depth = query->m_locals_depths[i];
+                const int f_context_depth = query->m_depths[i].locals_depth;
                 if (!query->is_allowed_solution(f_context_depth, f_solution))
                     return nullptr;
 
@@ -215,18 +256,17 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
                              : f;
 
                 new_indeterminates.push_back(f_solution);
-                new_depths.push_back(query->m_depths[i]); // same depth as f
-                new_locals_depths.push_back(query->m_locals_depths[i]); // same context depth as f
+                new_depths.push_back(query->m_depths[i]); // same depth and context depth as f
             }
 
             // Local depth condition
-            if (query->m_locals_depths[i] < locals_depth_tracker)
+            if (query->m_depths[i].locals_depth < locals_depth_tracker)
                 return nullptr;
-            locals_depth_tracker = query->m_locals_depths[i];
+            locals_depth_tracker = query->m_depths[i].locals_depth;
 
             // Store solution, remove from unmapped, assert match, and signal changes
             if (f_solution != f) {
-                new_solutions.emplace(f, f_solution);
+                new_solutions.emplace_back(f, f_solution);
                 infected.push_back(f);
             }
             query_to_sub_query.assert_matches(f, f_solution);
@@ -261,7 +301,7 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
                     const auto &g = telescope[j];
                     const auto &g_solution = matcher.get_solution(g);
                     if (g_solution ? g_solution.depends_on({f}) : g.signature_depends_on({f})) {
-                        f_context_depth = query->m_locals_depths[j];
+                        f_context_depth = query->m_depths[j].locals_depth;
                         break; // since context depths are non-decreasing, we can simply break here
                     }
                 }
@@ -275,8 +315,7 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
                 argument = query_to_sub_query.clone(f);
 
                 new_indeterminates.push_back(argument);
-                new_depths.push_back(h_depth + 1); // indeterminate was introduced because of h, so h_depth + 1
-                new_locals_depths.push_back(f_context_depth);
+                new_depths.push_back({(uint16_t) (h_depth + 1), (uint16_t) f_context_depth}); // indeterminate was introduced because of h, so h_depth + 1
             }
 
             // Store solution, remove from unmapped, assert match, and signal changes
@@ -310,22 +349,25 @@ std::shared_ptr<Query> Query::reduce(const std::shared_ptr<Query> &query, const
     try {
         // Note that thm itself must also be converted, since it might have changed along the way to sub_query!
         // E.g. for something like (not precisely) `search (P {A B : Prop} (h (a : A) : B) (x : A) : B)`
-        auto h_solution = query_to_sub_query.convert(thm).specialize({}, std::move(thm_arguments));
-        new_solutions.emplace(h, std::move(h_solution));
+        auto h_solution = query_to_sub_query.convert(thm).specialize({}, thm_arguments);
+        new_solutions.emplace_back(h, std::move(h_solution));
     } catch (SpecializationException &e) {
         CANARD_ASSERT(false, "Ai ai ai! Not what was supposed to happen!");
     }
 
     // Create the reduced query based on the solutions and new indeterminates
-    const int new_context_depth = max(new_locals_depths);
-    new_locals.erase(new_locals.begin() + new_context_depth, new_locals.end());
+    // Note: the layers of local functions that did not change are shared with query
+    const int new_context_depth = max_locals_depth(new_depths);
+    Locals new_locals_shared = query->m_locals;
+    new_locals_shared.truncate(new_context_depth);
+    for (int i = 0; i < new_context_depth; ++i)
+        new_locals_shared.set(i, new_locals[i]);
     std::shared_ptr<Query> sub_query(new Query(
             query,
             Telescope(new_indeterminates),
-            std::move(new_depths),
-            std::move(new_locals),
-            std::move(new_locals_depths),
-            std::move(new_solutions)
+            new_depths,
+            std::move(new_locals_shared),
+            new_solutions
     ));
 
     return sub_query;
@@ -335,12 +377,12 @@ std::vector<FunctionRef> Query::final_solutions() const {
     // This can only be done if this query is solved
     CANARD_ASSERT(is_solved(), "cannot call final_solutions on unsolved query");
 
-    // Create chain of queries, starting at the bottom, all the way up to the top
-    // Note: we include every query which contains a parent, so the initial query will not be included
-    std::vector<const Query *> chain;
-    for (const Query *query = this; query->parent() != nullptr; query = query->parent().get())
-        chain.push_back(query);
-    const Query &initial_query = *(chain.back()->parent());
+    // Create chain of traces, starting at the bottom, all the way up to the top
+    // Note: we include every trace which contains a parent, so the trace of the initial query will not be included
+    std::vector<const Trace *> chain;
+    for (const Trace *trace = m_trace.get(); trace->parent != nullptr; trace = trace->parent.get())
+        chain.push_back(trace);
+    const Trace &initial_trace = *(chain.back()->parent);
 
     /* The idea is as follows: starting at the back, `matcher` will functions from Query ..., 4, 3, 2, 1 to the solution,
        at each step using the previous matcher
@@ -354,21 +396,21 @@ std::vector<FunctionRef> Query::final_solutions() const {
     std::vector<std::unique_ptr<Matcher>> matchers;
     std::vector<std::unique_ptr<std::vector<FunctionRef>>> indeterminates;
     for (int i = 0; i < n; ++i) {
-        auto &query = chain[i];
-        CANARD_ASSERT(query->parent() != nullptr, "Chain should only contain queries which have a parent"); // (just to be sure)
+        auto &trace = chain[i];
+        CANARD_ASSERT(trace->parent != nullptr, "Chain should only contain traces which have a parent"); // (just to be sure)
 
         // The indeterminates of the matcher are the keys of the solution set of the query
         auto next_indeterminates = std::unique_ptr<std::vector<FunctionRef>>(new std::vector<FunctionRef>());
-        next_indeterminates->reserve(query->m_solutions.size());
-        for (auto &entry: query->m_solutions)
+        next_indeterminates->reserve(trace->solutions.size());
+        for (auto &entry: trace->solutions)
             next_indeterminates->push_back(entry.first);
         auto next_matcher = std::unique_ptr<Matcher>((i == 0)
                                                      ? new Matcher(*next_indeterminates)
                                                      : new Matcher(matchers.back().get(), *next_indeterminates));
         indeterminates.push_back(std::move(next_indeterminates));
 
-        const auto &h = query->parent()->goal();
-        for (auto &entry: query->m_solutions) {
+        const auto &h = trace->goal;
+        for (auto &entry: trace->solutions) {
             const auto &f = entry.first;
             auto f_solution = entry.second;
 
@@ -405,14 +447,70 @@ std::vector<FunctionRef> Query::final_solutions() const {
         matchers.push_back(std::move(next_matcher));
     }
     // Finally, we can sort_and_convert the telescope of the initial query
-    return matchers.back()->convert(initial_query.telescope().functions());
+    return matchers.back()->convert(initial_trace.goals);
+}
+
+bool contains_in_order(const std::vector<FunctionRef> &v, const std::vector<FunctionRef> &w) {
+    auto it_w = w.begin();
+    for (auto it_v = v.begin(); it_v != v.end(); ++it_v) {
+        while (true) {
+            if (it_w == w.end())
+                return false;
+            if (*it_w == *it_v) {
+                ++it_w;
+                break;
+            }
+            ++it_w;
+        }
+    }
+    return true;
+}
+
+bool Query::is_easier_than(const Query &other) const {
+    // Quick check: if p has a question that q does not have, or if q has a local variable that p does not have,
+    // then this is usually already visible from the fingerprints
+    if ((m_telescope_fingerprint & ~other.m_telescope_fingerprint) != 0 ||
+        (other.m_locals_fingerprint & ~m_locals_fingerprint) != 0)
+        return false;
+
+    const auto &p_variables = m_telescope.functions();
+    const auto &q_variables = other.m_telescope.functions();
+
+    if (p_variables.size() > q_variables.size()) // If p has more questions than q, return false
+        return false;
+
+    const auto &p_locals = m_locals;
+    const auto &q_locals = other.m_locals;
+
+    if (q_locals.size() > p_locals.size()) // If q has more local variables than p (i.e. more information), return false
+        return false;
+
+    // If p has a question that q does not have, return false
+    if (!contains_in_order(p_variables, q_variables))
+        return false;
+
+    // If q has a local variable that p does not have, return false
+    for (size_t i = 0; i < q_locals.size(); ++i) {
+        if ((q_locals.fingerprint(i) & ~p_locals.fingerprint(i)) != 0 || !contains_in_order(q_locals[i], p_locals[i]))
+            return false;
+    }
+
+    return true;
+}
+
+bool Query::may_have_easier_parent() const {
+    // If some parent p is easier than this query, then the telescope fingerprint of p is contained in that of this query,
+    // and the locals fingerprint of this query is contained in that of p. Both conditions can be checked for all parents at once.
+    return m_trace->parent != nullptr &&
+           (m_parents_telescope_fingerprint & ~m_telescope_fingerprint) == 0 &&
+           (m_locals_fingerprint & ~m_parents_locals_fingerprint) == 0;
 }
 
 bool Query::is_allowed_solution(const int context_depth, const FunctionRef &solution) {
     CANARD_ASSERT(context_depth <= m_locals.size(), "context_depth > m_locals.size()");
     // A solution is allowed only if it does not depend on contexts deeper than context_depth
-    for (auto it = m_locals.begin() + context_depth; it != m_locals.end(); ++it) {
-        if (solution.depends_on(*it))
+    for (size_t i = context_depth; i < m_locals.size(); ++i) {
+        if (solution.depends_on(m_locals[i]))
             return false;
     }
     return true;
@@ -436,8 +534,8 @@ int Query::compute_complexity() const {
     int cost = 0;
     for (int i = 0; i < m_telescope.size(); ++i) {
         cost += 1;
-        cost += m_depths[i];
-        cost += m_locals_depths[i];
+        cost += m_depths[i].depth;
+        cost += m_depths[i].locals_depth;
     }
     cost += (int) (10000 * telescope().size());
 //    cost += (int) (100 * max(m_depths));
@@ -445,29 +543,50 @@ int Query::compute_complexity() const {
     return cost;
 }
 
+uint64_t Query::fingerprint(const FunctionRef &f) {
+    // Use the (mixed) bits of the pointer to choose one of 64 bits
+    auto x = (uint64_t) std::hash<FunctionRef>()(f);
+    return (uint64_t) 1 << ((x * 0x9e3779b97f4a7c15ULL) >> 58);
+}
+
+uint64_t Query::compute_telescope_fingerprint() const {
+    uint64_t fingerprint = 0;
+    for (const auto &f: m_telescope.functions())
+        fingerprint |= Query::fingerprint(f);
+    return fingerprint;
+}
+
 int Query::compute_depth() const {
-    return max(m_depths);
+    int max = 0;
+    for (const auto &d: m_depths) {
+        if (d.depth > max)
+            max = d.depth;
+    }
+    return max;
+}
+
+uint64_t Query::next_id() {
+    static std::atomic<uint64_t> counter(NO_CHECKPOINT);
+    return ++counter;
 }
 
 bool Query::set_checkpoint(const Query &other) {
-    if (m_checkpoint == nullptr) {
-        m_checkpoint = &other;
-        return true;
-    }
-    return false;
+    // Only the first checkpoint is stored, also when multiple threads try to set one at the same time
+    uint64_t expected = NO_CHECKPOINT;
+    return m_checkpoint.compare_exchange_strong(expected, other.m_id, std::memory_order_acq_rel, std::memory_order_acquire);
 }
 
 int Query::distance_to_checkpoint() const {
     int distance = 0;
-    for (const Query *p = parent().get(); p != nullptr; p = p->parent().get()) {
+    for (std::shared_ptr<Query> p = parent(); p != nullptr; p = p->parent()) {
         ++distance;
-        if (p->checkpoint()) {
+        if (p->has_checkpoint()) {
             // Make sure that the checkpoint is also one of the parents of query
             distance = 1;
-            const Query *q = parent().get();
-            while (q != p && q != p->checkpoint()) {
+            std::shared_ptr<Query> q = parent();
+            while (q != p && q->id() != p->checkpoint()) {
                 ++distance;
-                q = q->parent().get();
+                q = q->parent();
             }
             if (q == p) // (i.e. checkpoint not found)
                 return distance;
@@ -475,3 +594,131 @@ int Query::distance_to_checkpoint() const {
     }
     return distance;
 }
+
+template<typename T, typename F>
+void write_shared(Serializer &serializer, std::unordered_map<const void *, uint64_t> &ids, const T *object, F write_object) {
+    // Shared objects are written as 0 for null, 1 followed by the object, or 2 + id for an object that was written before
+    if (object == nullptr) {
+        serializer.write_int(0);
+        return;
+    }
+    auto it = ids.find(object);
+    if (it != ids.end()) {
+        serializer.write_int(2 + it->second);
+        return;
+    }
+    serializer.write_int(1);
+    write_object(*object);
+    const auto id = ids.size();
+    ids.emplace(object, id);
+}
+
+template<typename T, typename F>
+std::shared_ptr<T> read_shared(Deserializer &deserializer, std::vector<std::shared_ptr<T>> &objects, F read_object) {
+    const auto tag = deserializer.read_int();
+    if (tag == 0)
+        return nullptr;
+    if (tag == 1) {
+        std::shared_ptr<T> object = read_object();
+        objects.push_back(object);
+        return object;
+    }
+    if (tag - 2 >= objects.size())
+        throw SerializationException("invalid reference");
+    return objects[tag - 2];
+}
+
+void write_trace(Serializer &serializer, Query::Serialization &serialization, const Query::Trace *trace) {
+    write_shared(serializer, serialization.trace_ids, trace, [&](const Query::Trace &t) {
+        write_trace(serializer, serialization, t.parent.get());
+        serializer.write(t.goal);
+        serializer.write_int(t.solutions.size());
+        for (const auto &entry: t.solutions) {
+            serializer.write(entry.first);
+            serializer.write(entry.second);
+        }
+        serializer.write(t.goals);
+    });
+}
+
+std::shared_ptr<const Query::Trace> read_trace(Deserializer &deserializer, Query::Serialization &serialization) {
+    return read_shared(deserializer, serialization.traces, [&]() {
+        auto parent = read_trace(deserializer, serialization);
+        auto goal = deserializer.read();
+        Query::Solutions solutions(deserializer.read_int());
+        for (auto &entry: solutions) {
+            entry.first = deserializer.read();
+            entry.second = deserializer.read();
+        }
+        auto goals = deserializer.read_functions();
+        return std::make_shared<const Query::Trace>(Query::Trace{std::move(parent), std::move(goal), std::move(solutions), std::move(goals)});
+    });
+}
+
+void Query::write(Serializer &serializer, Serialization &serialization, const std::shared_ptr<Query> &query) {
+    // Note: the parents of a query are written first, so that they are read first as well
+    write_shared(serializer, serialization.query_ids, query.get(), [&](const Query &q) {
+        write(serializer, serialization, q.parent());
+        write_trace(serializer, serialization, q.m_trace.get());
+        serializer.write(q.m_telescope.functions());
+        serializer.write_int(q.m_depths.size());
+        for (const auto &d: q.m_depths) {
+            serializer.write_int(d.depth);
+            serializer.write_int(d.locals_depth);
+        }
+        serializer.write_int(q.m_locals.size());
+        for (size_t i = 0; i < q.m_locals.size(); ++i) {
+            write_shared(serializer, serialization.layer_ids, q.m_locals.shared_layer(i).get(), [&](const Locals::Layer &layer) {
+                serializer.write(layer.functions);
+            });
+        }
+        serializer.write_int(q.m_id);
+        serializer.write_int(q.checkpoint());
+        serializer.write_int(q.is_retired());
+    });
+}
+
+std::shared_ptr<Query> Query::read(Deserializer &deserializer, Serialization &serialization) {
+    return read_shared(deserializer, serialization.queries, [&]() {
+        auto parent = read(deserializer, serialization);
+        auto trace = read_trace(deserializer, serialization);
+        if (trace == nullptr)
+            throw SerializationException("query without trace");
+        Telescope telescope(deserializer.read_functions());
+        std::vector<Depths> depths(deserializer.read_int());
+        for (auto &d: depths) {
+            d.depth = (uint16_t) deserializer.read_int();
+            d.locals_depth = (uint16_t) deserializer.read_int();
+        }
+        if (depths.size() != telescope.size())
+            throw SerializationException("invalid query");
+        Locals locals;
+        const auto locals_size = deserializer.read_int();
+        for (uint64_t i = 0; i < locals_size; ++i) {
+            auto layer = read_shared(deserializer, serialization.layers, [&]() {
+                return std::make_shared<const Locals::Layer>(deserializer.read_functions());
+            });
+            if (layer == nullptr)
+                throw SerializationException("invalid query");
+            locals.push(std::move(layer));
+        }
+        std::shared_ptr<Query> query(new Query(std::move(parent), std::move(trace), std::move(telescope), std::move(depths), std::move(locals)));
+        serialization.ids.emplace(deserializer.read_int(), query->m_id);
+        const auto checkpoint = deserializer.read_int();
+        if (checkpoint != NO_CHECKPOINT)
+            serialization.checkpoints.emplace_back(query, checkpoint);
+        if (deserializer.read_int() != 0)
+            query->retire();
+        return query;
+    });
+}
+
+void Query::restore_checkpoints(Serialization &serialization) {
+    // Checkpoints refer to queries by their id, which changed when the queries were read.
+    // A checkpoint whose query was not written (i.e. it was freed) gets an id that refers to no query at all.
+    for (auto &entry: serialization.checkpoints) {
+        auto it = serialization.ids.find(entry.second);
+        entry.first->m_checkpoint.store(it != serialization.ids.end() ? it->second : next_id(), std::memory_order_release);
+    }
+    serialization.checkpoints.clear();
+}
@@ -7,56 +7,131 @@
 #include "../core/Function.h"
 #include "../core/Matcher.h"
 #include "../data/Context.h"
+#include "../data/Serializer.h"
+#include "Locals.h"
+#include "MatchProgram.h"
 #include <memory>
+#include <cstdint>
+#include <atomic>
+#include <unordered_map>
 
 class Query {
 public:
 
+    struct Depths {
+        uint16_t depth; // number of reductions that led to the goal
+        uint16_t locals_depth; // number of layers of local functions the goal may depend on
+    };
+
+    typedef std::vector<std::pair<FunctionRef, FunctionRef>> Solutions;
+
+    // The solutions of a query relative to its parent, which is all that is needed to compute the final solutions.
+    // Traces are kept apart from the queries themselves, so that the parents of a query may be freed during the search.
+    struct Trace {
+        const std::shared_ptr<const Trace> parent;
+        const FunctionRef goal; // goal of the parent query that was solved for
+        const Solutions solutions;
+        const std::vector<FunctionRef> goals; // only for the initial query: its goals
+    };
+
+    // Buffers used by `reduce`, which are reused between calls so that failed reductions do not allocate.
+    // A workspace must not be shared between threads.
+    struct Workspace {
+        std::vector<FunctionRef> indeterminates_total, new_indeterminates, thm_arguments, mappable, unmapped, infected;
+        std::vector<Depths> new_depths;
+        Solutions new_solutions;
+        std::vector<std::vector<FunctionRef>> new_locals, unmapped_locals;
+        std::vector<int> unmapped_telescope_indices, unmapped_thm_parameter_indices;
+        MatchProgram::Registers registers;
+    };
+
     static std::shared_ptr<Query> normalize(const std::shared_ptr<Query> &);
-    static std::shared_ptr<Query> reduce(const std::shared_ptr<Query> &, const FunctionRef &);
+    static std::shared_ptr<Query> reduce(const std::shared_ptr<Query> &, const FunctionRef &, Workspace &, const MatchProgram * = nullptr);
 
     explicit Query(Telescope);
 
-    const std::shared_ptr<Query> &parent() const { return m_parent; }
+    std::shared_ptr<Query> parent() const { return std::atomic_load(&m_parent); }
+    void release_parent() { std::atomic_store(&m_parent, std::shared_ptr<Query>()); }
     const Telescope &telescope() const { return m_telescope; }
-    const std::vector<std::vector<FunctionRef>> &locals() const { return m_locals; }
-    const std::vector<int> &depths() const { return m_depths; }
-    const std::vector<int> &locals_depths() const { return m_locals_depths; }
-    const std::unordered_map<FunctionRef, FunctionRef> &solutions() const { return m_solutions; }
+    const Locals &locals() const { return m_locals; }
+    const std::vector<Depths> &depths() const { return m_depths; }
+    const Solutions &solutions() const { return m_trace->solutions; }
+    const std::shared_ptr<const Trace> &trace() const { return m_trace; }
     const FunctionRef &goal(int * = nullptr) const;
     int depth() const { return m_depth; };
     int complexity() const { return m_complexity; };
+    uint64_t telescope_fingerprint() const { return m_telescope_fingerprint; }
+    uint64_t locals_fingerprint() const { return m_locals_fingerprint; }
+    bool may_have_easier_parent() const;
 
     bool is_solved() const { return goal() == nullptr; }
+    bool is_easier_than(const Query &) const;
     std::vector<FunctionRef> final_solutions() const; // TODO: maybe rename this to `backtrack_solutions` or `compute_solutions` or something
 
-    const Query *checkpoint() const { return m_checkpoint; }
+    static const uint64_t NO_CHECKPOINT = 0;
+
+    uint64_t id() const { return m_id; }
+    uint64_t checkpoint() const { return m_checkpoint.load(std::memory_order_acquire); }
+    bool has_checkpoint() const { return checkpoint() != NO_CHECKPOINT; }
     int distance_to_checkpoint() const;
     bool set_checkpoint(const Query &);
 
+    bool is_retired() const { return m_retired.load(std::memory_order_relaxed); }
+    void retire() { m_retired.store(true, std::memory_order_relaxed); }
+
+    static uint64_t fingerprint(const FunctionRef &);
+
+    // State for writing or reading queries, see `Searcher::save`. Traces, layers of local functions and parents
+    // which are shared between queries are written only once.
+    struct Serialization {
+        std::unordered_map<const void *, uint64_t> trace_ids, layer_ids, query_ids; // for writing
+        std::vector<std::shared_ptr<const Trace>> traces; // for reading
+        std::vector<std::shared_ptr<const Locals::Layer>> layers;
+        std::vector<std::shared_ptr<Query>> queries;
+        std::unordered_map<uint64_t, uint64_t> ids; // ids of the queries that were written, to restore checkpoints
+        std::vector<std::pair<std::shared_ptr<Query>, uint64_t>> checkpoints;
+    };
+
+    static void write(Serializer &, Serialization &, const std::shared_ptr<Query> &);
+    static std::shared_ptr<Query> read(Deserializer &, Serialization &);
+    static void restore_checkpoints(Serialization &);
+
 private:
 
     Query(std::shared_ptr<Query> query,
           Telescope telescope,
-          std::vector<int> depths,
-          std::vector<std::vector<FunctionRef>> locals,
-          std::vector<int> locals_depths,
-          std::unordered_map<FunctionRef, FunctionRef> solutions);
+          std::vector<Depths> depths,
+          Locals locals,
+          Solutions solutions);
 
-    const std::shared_ptr<Query> m_parent;
+    Query(std::shared_ptr<Query> parent,
+          std::shared_ptr<const Trace> trace,
+          Telescope telescope,
+          std::vector<Depths> depths,
+          Locals locals);
+
+    std::shared_ptr<Query> m_parent; // only accessed atomically, as it may be released during the search (see `Searcher::release_parents`)
+    const std::shared_ptr<const Trace> m_trace;
     const Telescope m_telescope;
-    const std::vector<int> m_depths;
-    const std::vector<std::vector<FunctionRef>> m_locals;
-    const std::vector<int> m_locals_depths;
-    const std::unordered_map<FunctionRef, FunctionRef> m_solutions;
+    const std::vector<Depths> m_depths;
+    const Locals m_locals;
     const int m_depth;
     const int m_complexity;
+    const uint64_t m_telescope_fingerprint; // one bit per (hash of a) function in the telescope
+    const uint64_t m_locals_fingerprint; // one bit per (hash of a) local function
+    const uint64_t m_parents_telescope_fingerprint; // intersection of the telescope fingerprints of all parents
+    const uint64_t m_parents_locals_fingerprint; // union of the locals fingerprints of all parents
 
-    const Query *m_checkpoint = nullptr;
+    const uint64_t m_id; // unique and non-zero, used to refer to checkpoints without keeping them alive
+    std::atomic<uint64_t> m_checkpoint{NO_CHECKPOINT};
+    std::atomic<bool> m_retired{false};
 
     bool is_allowed_solution(int, const FunctionRef &);
 
     int compute_depth() const;
     int compute_complexity() const;
+    uint64_t compute_telescope_fingerprint() const;
+
+    static uint64_t next_id();
 
 };
@@ -0,0 +1,30 @@
+#include "QueryQueue.h"
+
+void QueryQueue::push(std::shared_ptr<Query> query) {
+    const int complexity = query->complexity();
+    push(std::move(query), complexity);
+}
+
+void QueryQueue::push(std::shared_ptr<Query> query, int priority) {
+    m_buckets[priority].push_back(std::move(query));
+    ++m_size;
+}
+
+std::shared_ptr<Query> QueryQueue::pop() {
+    if (m_size == 0)
+        return nullptr;
+
+    // Take the oldest query of the bucket with the lowest complexity, and remove the bucket if it becomes empty
+    auto it = m_buckets.begin();
+    auto query = std::move(it->second.front());
+    it->second.pop_front();
+    if (it->second.empty())
+        m_buckets.erase(it);
+    --m_size;
+    return query;
+}
+
+void QueryQueue::clear() {
+    m_buckets.clear();
+    m_size = 0;
+}
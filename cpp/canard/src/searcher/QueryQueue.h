@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Query.h"
+#include <map>
+#include <deque>
+#include <memory>
+
+class QueryQueue {
+public:
+
+    void push(std::shared_ptr<Query>);
+    void push(std::shared_ptr<Query>, int);
+    std::shared_ptr<Query> pop();
+    void clear();
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    int priority() const { return m_buckets.begin()->first; } // lowest priority in the queue, which must be non-empty
+
+    // Calls f(query, priority) for every query, in the order in which they would be popped
+    template<typename F>
+    void for_each(F f) const {
+        for (const auto &bucket: m_buckets) {
+            for (const auto &query: bucket.second)
+                f(query, bucket.first);
+        }
+    }
+
+private:
+
+    // Queries are put in buckets by their complexity (or a given priority). Within a bucket, queries are taken in the order in which they were pushed.
+    // Note that there are only few distinct complexities at any time, so the number of buckets stays small.
+    std::map<int, std::deque<std::shared_ptr<Query>>> m_buckets;
+    size_t m_size = 0;
+
+};
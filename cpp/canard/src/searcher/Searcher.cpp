@@ -6,56 +6,131 @@
 #include "../core/macros.h"
 #include "../parser/Formatter.h"
 #include <algorithm>
+#include <bitset>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
-Searcher::Searcher(const std::unordered_set<Context *> &spaces,
+Searcher::Searcher(std::shared_ptr<const Index> index,
                    const int max_depth,
-                   const int max_threads) : m_max_depth(max_depth),
-                                            m_index(spaces),
+                   const int max_threads,
+                   const int max_premises,
+                   const int max_queries) : m_max_depth(max_depth),
+                                            m_max_premises(max_premises),
+                                            m_max_queries(max_queries),
+                                            m_index(std::move(index)),
                                             m_thread_manager(max_threads),
                                             m_searching(false) {}
 
-bool Searcher::search(const Telescope &telescope, int max_results) {
-    // Clear searcher
+bool Searcher::search(const Telescope &telescope, int max_results, bool resumable) {
+    // Clear searcher, and start the search
     clear();
+    return start(telescope, max_results, resumable);
+}
+
+bool Searcher::start(const Telescope &telescope, int max_results, bool resumable) {
+    // Set max_results and the index to use
+    m_max_results = max_results;
+    m_resumable = resumable;
+    m_single_result = (max_results == 1 && !resumable);
     // Place initial query
-    m_queue.push({std::make_shared<Query>(telescope), {}});
+    auto query = std::make_shared<Query>(telescope);
+    if (m_single_result)
+        m_frontier.insert(query);
+    m_queue.push(std::move(query));
     // Reset counter
     m_query_counter = 1;
-    // Set max_results
-    m_max_results = max_results;
     if (max_results == 0)
         return true;
+    run();
+    return !m_results.empty();
+}
+
+bool Searcher::resume(int max_results) {
+    CANARD_ASSERT(m_resumable, "only resumable searches can be resumed");
+    // First deliver the results that were found after the previous page was complete
+    const int delivered = m_result_counter;
+    m_max_results = m_result_counter + max_results;
+    while (m_result_counter < m_max_results && m_result_counter < (int) m_results.size())
+        deliver(m_results[m_result_counter++]);
+    // Then continue the search for the remaining results
+    if (m_result_counter < m_max_results && !(m_queue.empty() && m_deferred.empty()))
+        run();
+    return m_result_counter > delivered;
+}
+
+bool Searcher::resume() {
+    // Continue an interrupted search, until it has found the number of results it was started with
+    CANARD_ASSERT(m_interrupted, "only interrupted searches can be resumed");
+    m_interrupted = false;
+    if (m_result_counter < m_max_results && !(m_queue.empty() && m_deferred.empty()))
+        run();
+    return !m_results.empty();
+}
+
+bool Searcher::can_resume() const {
+    return m_resumable && ((int) m_results.size() > m_result_counter || !(m_queue.empty() && m_deferred.empty()));
+}
+
+void Searcher::set_result_callback(ResultCallback callback) {
+    m_result_callback = std::move(callback);
+}
+
+void Searcher::run() {
     // Create a pool of threads
     m_searching = true;
+    m_pausing = false;
     m_thread_manager.start(&Searcher::search_loop, this);
-    // Wait for all threads to end, and return
+    // Wait for all threads to end
     m_thread_manager.join_all();
-    return !m_results.empty();
+}
+
+void Searcher::deliver(const std::vector<FunctionRef> &result) {
+    if (m_result_callback)
+        m_result_callback(result);
 }
 
 bool Searcher::prove(const FunctionRef &f) {
     CANARD_ASSERT(f->is_base(), "prove only works on base functions");
-    // Call `search` after marking f as excluded
+    // Call `search` after marking f as excluded, so that the theorems that depend on f are skipped (see `is_excluded`)
+    // Note: f stays excluded until the searcher is cleared, so that the search can be resumed when interrupted
+    clear();
     m_excluded_thm = f;
-    bool success = search(Telescope({f}));
-    m_excluded_thm = nullptr;
-    return success;
+    return start(Telescope({f}));
+}
+
+void Searcher::set_interrupt(const std::atomic<bool> *interrupt) {
+    m_interrupt = interrupt;
+}
+
+void Searcher::set_index(std::shared_ptr<const Index> index) {
+    // Replace the index. A paused search uses the previous index, so it cannot be resumed anymore
+    if (index == m_index)
+        return;
+    if (m_resumable || m_interrupted)
+        clear();
+    m_index = std::move(index);
 }
 
 void Searcher::search_loop() {
+    // Each thread has its own buffers for reducing queries
+    Query::Workspace workspace;
+
     // TODO: can we get rid of `goto`'s ?
-    while (m_searching) {
-        // Take the first query from the first (non-empty) queue, i.e. the one with the lowest depth
-        std::shared_ptr<Query> query = nullptr;
-        std::vector<int> order;
-        m_mutex.lock();
-        if (!m_queue.empty()) {
-            auto &entry = m_queue.top();
-            query = entry.query;
-            order.reserve(entry.order.size() + 1); // already reserve for an extra entry
-            order.insert(order.end(), entry.order.begin(), entry.order.end());
-            m_queue.pop();
+    // Note: when pausing, the queries that are being reduced are finished first, so that the search can be resumed
+    while (m_searching && !m_pausing) {
+        // When interrupted, pause the search so that it can be saved or resumed
+        if (m_interrupt != nullptr && m_interrupt->load()) {
+            m_interrupted = true;
+            m_pausing = true;
+            break;
         }
+
+        // Take the first query from the queue, i.e. the oldest one with the lowest complexity
+        // Queries whose remaining premises were deferred are taken as if they had one more goal
+        m_mutex.lock();
+        const bool fallback = !m_deferred.empty() && (m_queue.empty() || m_deferred.priority() < m_queue.priority());
+        std::shared_ptr<Query> query = fallback ? m_deferred.pop() : m_queue.pop();
         m_mutex.unlock();
 
         // If there is no query, we should wait for other threads to come with updates
@@ -67,55 +142,83 @@ void Searcher::search_loop() {
                 break;
         }
 
-        // Normalize the query before reducing: convert parameters of telescope to local variables
-        query = Query::normalize(query);
-
-        // Check for redundancies
-        if (!check_reasonable(query, query->parent()))
+        // Skip queries that were retired in favour of an easier query
+        if (query->is_retired())
             continue;
 
+        // Normalize the query before reducing: convert parameters of telescope to local variables
+        // Check for redundancies (queries in the fallback pass were already normalized and checked)
+        if (!fallback) {
+            query = Query::normalize(query);
+            if (!check_reasonable(query, query->parent()))
+                continue;
+        }
+
         // Check for checkpoints
         if (!check_checkpoints(query))
             continue;
 
+        // The parents that are too far up for the checks of this query (and the queries below it) can be released
+        release_parents(query);
+
         // Now we are going to look for reductions. Before pushing to the queue, we will store all reductions
         // in a list `reductions`. Then we will sort this list based on the number of telescope, which is
         // some form of optimization
         const auto &h_type_base = query->goal().type().base();
         std::vector<std::shared_ptr<Query>> reductions;
+        bool deferred = false;
+
+        const auto &telescope = query->telescope();
+        const bool generic_goal = telescope.contains(h_type_base);
 
         // First list to search through is the list of local variables of query
-        for (const auto &local_layer: query->locals()) {
-            for (const auto &thm: local_layer) {
-                switch (search_helper(query, thm, reductions)) {
-                    case SEARCH_CONTINUE:
+        // Only those whose type base may match that of the goal are tried: the same base, one of their own parameters,
+        // or an indeterminate of the query. Layers without any of these are skipped by their fingerprint of heads.
+        if (!fallback) {
+            const auto &locals = query->locals();
+            const uint64_t relevant_heads = Query::fingerprint(h_type_base) | query->telescope_fingerprint();
+            for (size_t l = 0; l < locals.size(); ++l) {
+                const auto &local_layer = locals.layer(l);
+                if (!generic_goal && !local_layer.has_generic && (local_layer.heads_fingerprint & relevant_heads) == 0)
+                    continue;
+                for (size_t i = 0; i < local_layer.functions.size(); ++i) {
+                    const auto &head = local_layer.heads[i];
+                    if (!generic_goal && head != nullptr && head != h_type_base && !telescope.contains(head))
                         continue;
-                    case SEARCH_STOP:
-                        goto end_theorems;
-                    case SEARCH_DONE:
-                        goto end_while;
+                    const auto &thm = local_layer.functions[i];
+                    if (m_excluded_thm != nullptr && thm.depends_on({m_excluded_thm}))
+                        continue;
+                    switch (search_helper(query, thm, nullptr, reductions, workspace)) {
+                        case SEARCH_CONTINUE:
+                            continue;
+                        case SEARCH_STOP:
+                            goto end_theorems;
+                        case SEARCH_DONE:
+                            goto end_while;
+                    }
                 }
             }
         }
 
         // If the type base is an indeterminate of query, there is nothing better to do then to try all theorems
-        if (query->telescope().contains(h_type_base)) {
-            for (auto &thm: m_index.all_theorems()) {
-                switch (search_helper(query, thm, reductions)) {
-                    case SEARCH_CONTINUE:
-                        continue;
-                    case SEARCH_STOP:
-                        goto end_theorems;
-                    case SEARCH_DONE:
-                        goto end_while;
-                }
+        // (or rather, the theorems selected as premises, see `search_premises`)
+        if (generic_goal) {
+            switch (search_premises(query, m_index->all_theorems(), fallback, reductions, workspace, deferred)) {
+                case SEARCH_CONTINUE:
+                    break;
+                case SEARCH_STOP:
+                    goto end_theorems;
+                case SEARCH_DONE:
+                    goto end_while;
             }
         } else {
             // If the type base is known to the index, try the corresponding list of theorems
-            auto theorems = m_index.theorems(h_type_base);
+            auto theorems = fallback ? nullptr : m_index->theorems(h_type_base);
             if (theorems != nullptr) {
                 for (auto &thm: *theorems) {
-                    switch (search_helper(query, thm, reductions)) {
+                    if (is_excluded(thm))
+                        continue;
+                    switch (search_helper(query, thm.function, thm.program.get(), reductions, workspace)) {
                         case SEARCH_CONTINUE:
                             continue;
                         case SEARCH_STOP:
@@ -126,28 +229,50 @@ void Searcher::search_loop() {
                 }
             }
             // Also try the general theorems
-            for (auto &thm: m_index.generic_theorems()) {
-                switch (search_helper(query, thm, reductions)) {
-                    case SEARCH_CONTINUE:
-                        continue;
-                    case SEARCH_STOP:
-                        goto end_theorems;
-                    case SEARCH_DONE:
-                        goto end_while;
-                }
+            switch (search_premises(query, m_index->generic_theorems(), fallback, reductions, workspace, deferred)) {
+                case SEARCH_CONTINUE:
+                    break;
+                case SEARCH_STOP:
+                    goto end_theorems;
+                case SEARCH_DONE:
+                    goto end_while;
             }
         }
 
+        // The premises that were not selected are tried in a later pass, which keeps the search complete
+        if (deferred) {
+            m_mutex.lock();
+            m_deferred.push(query, query->complexity() + DEFERRED_PENALTY);
+            m_mutex.unlock();
+        }
+
         end_theorems:
 
-        // Then add them to the queue with increasing order
+        // When searching for multiple results, omit reductions that can only give the same results as another reduction
+        if (!m_single_result && reductions.size() > 1)
+            remove_duplicates(reductions);
+
+        // Rank the reductions, so that the most promising ones are taken first among the queries of the same complexity
+        if (reductions.size() > 1)
+            rank_reductions(reductions);
+
+        // Then add them to the queue in order
         m_mutex.lock();
-        order.push_back(0);
         for (auto &r: reductions) {
-            m_queue.push({std::move(r), order});
-            ++order.back();
+            // When searching for a single result, omit reductions that are subsumed by a known query,
+            // and retire the known queries that are subsumed by the reduction
+            if (m_single_result) {
+                if (m_frontier.is_subsumed(*r))
+                    continue;
+                m_frontier.retire_subsumed_by(*r);
+                m_frontier.insert(r);
+            }
+            m_queue.push(std::move(r));
             ++m_query_counter;
         }
+        // Give up once the maximum number of queries is reached
+        if (m_max_queries > 0 && m_query_counter >= m_max_queries)
+            m_searching = false;
         m_mutex.unlock();
 
         // Notify the other threads for updates
@@ -158,21 +283,20 @@ void Searcher::search_loop() {
     // Send a permanent update
     m_thread_manager.send_permanent_update(true);
     // When we are out of the loop, this boolean makes the other threads terminate as well
-    m_searching = false;
+    // (unless pausing, in which case they terminate after finishing their current query)
+    if (!m_pausing)
+        m_searching = false;
 }
 
 Searcher::SearchResult
-Searcher::search_helper(const std::shared_ptr<Query> &query, const FunctionRef &thm, std::vector<std::shared_ptr<Query>> &reductions) {
+Searcher::search_helper(const std::shared_ptr<Query> &query, const FunctionRef &thm, const MatchProgram *program,
+                        std::vector<std::shared_ptr<Query>> &reductions, Query::Workspace &workspace) {
     // Shortcut: if not searching anymore, just return false and be done with it
     if (!m_searching)
         return SEARCH_DONE;
 
-    // If thm is excluded, return false
-    if (m_excluded_thm != nullptr && thm.depends_on({m_excluded_thm}))
-        return SEARCH_CONTINUE;
-
     // Try reducing query using thm
-    auto sub_query = Query::reduce(query, thm);
+    auto sub_query = Query::reduce(query, thm, workspace, program);
     if (sub_query == nullptr)
         return SEARCH_CONTINUE;
 
@@ -180,10 +304,20 @@ Searcher::search_helper(const std::shared_ptr<Query> &query, const FunctionRef &
     // Append it to the vector of results, and continue if we want more results, and be done otherwise
     if (sub_query->is_solved()) {
         m_mutex.lock();
-        if (m_searching) {
-            m_results.push_back(sub_query->final_solutions());
-            if (++m_result_counter == m_max_results)
-                m_searching = false;
+        // Note: a resumable search keeps the results that are found while pausing, for the next page
+        // Results that are identical to an earlier result are omitted, they do not count towards max_results
+        if (m_searching && (m_result_counter < m_max_results || m_resumable) && add_result(sub_query->final_solutions())) {
+            if (m_trace)
+                CANARD_LOG("Query tree:\n" << Formatter().format_query_tree(*sub_query));
+            if (m_result_counter < m_max_results) {
+                deliver(m_results.back());
+                if (++m_result_counter == m_max_results) {
+                    if (m_resumable)
+                        m_pausing = true;
+                    else
+                        m_searching = false;
+                }
+            }
         }
         m_mutex.unlock();
         return (m_searching ? SEARCH_CONTINUE : SEARCH_DONE);
@@ -195,7 +329,7 @@ Searcher::search_helper(const std::shared_ptr<Query> &query, const FunctionRef &
 
     // If `sub_query` is easier than its parent, make it the only reduction
     // Only do this if we are searching for a single solution
-    if (m_max_results == 1 && is_easier_than(*sub_query, *query)) {
+    if (m_single_result && is_easier_than(*sub_query, *query)) {
         reductions = {sub_query};
         return SEARCH_STOP;
     }
@@ -205,97 +339,355 @@ Searcher::search_helper(const std::shared_ptr<Query> &query, const FunctionRef &
     return SEARCH_CONTINUE;
 }
 
+Searcher::SearchResult
+Searcher::search_premises(const std::shared_ptr<Query> &query, const std::vector<Index::Theorem> &theorems, const bool fallback,
+                          std::vector<std::shared_ptr<Query>> &reductions, Query::Workspace &workspace, bool &deferred) {
+    // Without a cut-off, or when there are few theorems, all of them are tried in the first pass
+    const size_t n = theorems.size();
+    if (m_max_premises <= 0 || n <= (size_t) m_max_premises) {
+        if (fallback)
+            return SEARCH_CONTINUE;
+        for (const auto &thm: theorems) {
+            if (is_excluded(thm))
+                continue;
+            auto result = search_helper(query, thm.function, thm.program.get(), reductions, workspace);
+            if (result != SEARCH_CONTINUE)
+                return result;
+        }
+        return SEARCH_CONTINUE;
+    }
+
+    // Otherwise, the first pass tries the selected theorems, and the fallback pass tries the others
+    // Note: the selection only depends on the query and the theorems, so both passes make the same selection
+    const auto selected = select_premises(*query, theorems);
+    for (size_t i = 0; i < n; ++i) {
+        if (selected[i] == fallback || is_excluded(theorems[i]))
+            continue;
+        auto result = search_helper(query, theorems[i].function, theorems[i].program.get(), reductions, workspace);
+        if (result != SEARCH_CONTINUE)
+            return result;
+    }
+    if (!fallback)
+        deferred = true;
+    return SEARCH_CONTINUE;
+}
+
+std::vector<bool> Searcher::select_premises(const Query &query, const std::vector<Index::Theorem> &theorems) const {
+    // Collect the symbols occurring in the query: in its goals and in its local variables
+    uint64_t symbols = 0;
+    for (const auto &f: query.telescope().functions())
+        symbols |= Index::symbols(f);
+    for (const auto &local_layer: query.locals()) {
+        for (const auto &f: local_layer)
+            symbols |= Index::symbols(f);
+    }
+
+    // Rank the theorems by the number of symbols they have in common with the query (theorems that are excluded are not selected).
+    // Ties are broken by the order of the theorems (i.e. by preference), and the best m_max_premises are selected
+    std::vector<std::pair<int, size_t>> ranking;
+    ranking.reserve(theorems.size());
+    for (size_t i = 0; i < theorems.size(); ++i) {
+        if (!is_excluded(theorems[i]))
+            ranking.emplace_back(-(int) std::bitset<64>(theorems[i].symbols & symbols).count(), i);
+    }
+    const int m = std::min(m_max_premises, (int) ranking.size());
+    std::partial_sort(ranking.begin(), ranking.begin() + m, ranking.end());
+
+    std::vector<bool> selected(theorems.size(), false);
+    for (int k = 0; k < m; ++k)
+        selected[ranking[k].second] = true;
+    return selected;
+}
+
+size_t canonical_hash(const FunctionRef &f) {
+    // A hash which agrees for identical functions (see `identical`). Functions with parameters are not inspected
+    // any further, so that all functions that are hashed are free (i.e. not parameters of an enclosing function)
+    const auto n = f->parameters().size();
+    if (n > 0)
+        return n;
+    auto h = (size_t) std::hash<FunctionRef>()(f.base());
+    if (!f->is_base()) {
+        for (const auto &argument: f->arguments())
+            h = (h * 1000003) ^ canonical_hash(argument);
+    }
+    return h;
+}
+
+bool identical(const FunctionRef &, const FunctionRef &, std::vector<std::pair<FunctionRef, FunctionRef>> &);
+
+bool identical_signatures(const FunctionRef &f, const FunctionRef &g, std::vector<std::pair<FunctionRef, FunctionRef>> &bound) {
+    // Whether the parameters and the types of f and g are identical, where the parameters are identified with each other
+    const auto &f_parameters = f->parameters().functions(), &g_parameters = g->parameters().functions();
+    if (f_parameters.size() != g_parameters.size())
+        return false;
+    const size_t n = bound.size();
+    bool result = true;
+    for (size_t i = 0; result && i < f_parameters.size(); ++i) {
+        result = identical_signatures(f_parameters[i], g_parameters[i], bound);
+        bound.emplace_back(f_parameters[i], g_parameters[i]);
+    }
+    result = result && identical(f.type(), g.type(), bound);
+    bound.resize(n);
+    return result;
+}
+
+bool identical(const FunctionRef &f, const FunctionRef &g, std::vector<std::pair<FunctionRef, FunctionRef>> &bound) {
+    // Whether f and g are the same up to renaming of parameters, where `bound` contains the parameters identified so far.
+    // Note: this is stricter than `FunctionRef::equivalent`, which may identify different parameters of the same function
+    for (auto it = bound.rbegin(); it != bound.rend(); ++it) {
+        if (it->first == f || it->second == g)
+            return it->first == f && it->second == g;
+    }
+    if (f == g)
+        return true;
+    if (f->is_base() || g->is_base())
+        return false;
+
+    const auto &f_parameters = f->parameters().functions(), &g_parameters = g->parameters().functions();
+    if (f_parameters.size() != g_parameters.size())
+        return false;
+    const size_t n = bound.size();
+    bool result = true;
+    for (size_t i = 0; result && i < f_parameters.size(); ++i) {
+        result = identical_signatures(f_parameters[i], g_parameters[i], bound);
+        bound.emplace_back(f_parameters[i], g_parameters[i]);
+    }
+    result = result && identical(f.base(), g.base(), bound);
+    const auto &f_arguments = f->arguments(), &g_arguments = g->arguments();
+    for (size_t i = 0; result && i < f_arguments.size(); ++i)
+        result = identical(f_arguments[i], g_arguments[i], bound);
+    bound.resize(n);
+    return result;
+}
+
+bool identical(const FunctionRef &f, const FunctionRef &g) {
+    std::vector<std::pair<FunctionRef, FunctionRef>> bound;
+    return identical(f, g, bound);
+}
+
+bool identical(const std::vector<FunctionRef> &a, const std::vector<FunctionRef> &b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!identical(a[i], b[i]))
+            return false;
+    }
+    return true;
+}
+
+bool Searcher::add_result(std::vector<FunctionRef> result) {
+    // Store the result, unless it is identical to a known result
+    size_t h = 0;
+    for (const auto &f: result)
+        h = (h * 1000003) ^ canonical_hash(f);
+    auto &indices = m_result_hashes[h];
+    for (const auto i: indices) {
+        if (identical(m_results[i], result))
+            return false;
+    }
+    indices.push_back(m_results.size());
+    m_results.push_back(std::move(result));
+    return true;
+}
+
+void Searcher::remove_duplicates(std::vector<std::shared_ptr<Query>> &reductions) {
+    // Reductions of the same query whose solutions are identical lead to the same search, and so to the same results.
+    // Note that such reductions cannot have new goals, as those are new functions for every reduction.
+    std::unordered_map<size_t, std::vector<size_t>> by_hash;
+    size_t kept = 0;
+    for (size_t i = 0; i < reductions.size(); ++i) {
+        const auto &solutions = reductions[i]->solutions();
+        size_t h = 0;
+        for (const auto &solution: solutions)
+            h = (h * 1000003) ^ (std::hash<FunctionRef>()(solution.first) + canonical_hash(solution.second));
+        auto &indices = by_hash[h];
+        const bool duplicate = std::any_of(indices.begin(), indices.end(), [&](size_t j) {
+            const auto &other = reductions[j]->solutions();
+            if (other.size() != solutions.size())
+                return false;
+            for (size_t k = 0; k < solutions.size(); ++k) {
+                if (other[k].first != solutions[k].first || !identical(other[k].second, solutions[k].second))
+                    return false;
+            }
+            return true;
+        });
+        if (duplicate)
+            continue;
+        indices.push_back(kept);
+        if (kept != i)
+            reductions[kept] = std::move(reductions[i]);
+        ++kept;
+    }
+    reductions.resize(kept);
+}
+
+void Searcher::rank_reductions(std::vector<std::shared_ptr<Query>> &reductions) const {
+    // Order by the estimated number of reductions of the next goal (ties keep their order)
+    // Note: this only matters among reductions of the same complexity, which have the same number of goals, and so also
+    // the same number of new indeterminates (as they are reductions of the same query)
+    std::vector<std::pair<size_t, size_t>> ranking;
+    ranking.reserve(reductions.size());
+    for (size_t i = 0; i < reductions.size(); ++i)
+        ranking.emplace_back(estimate_fan_out(*reductions[i]), i);
+    std::sort(ranking.begin(), ranking.end());
+
+    std::vector<std::shared_ptr<Query>> ranked;
+    ranked.reserve(reductions.size());
+    for (const auto &entry: ranking)
+        ranked.push_back(std::move(reductions[entry.second]));
+    reductions = std::move(ranked);
+}
+
+size_t Searcher::estimate_fan_out(const Query &query) const {
+    // The number of theorems that will be tried for the next goal of the query (see `search_loop`)
+    const auto &h_type_base = query.goal().type().base();
+    if (query.telescope().contains(h_type_base))
+        return m_index->all_theorems().size();
+    const auto theorems = m_index->theorems(h_type_base);
+    return (theorems != nullptr ? theorems->size() : 0) + m_index->generic_theorems().size();
+}
+
 void Searcher::clear() {
-    m_queue = {};
+    const bool large = (m_query_counter >= LARGE_SEARCH);
+    m_queue.clear();
+    m_deferred.clear();
+    m_frontier.clear();
     m_results.clear();
+    m_result_hashes.clear();
     m_query_counter = 0;
     m_result_counter = 0;
+    m_resumable = false;
+    m_interrupted = false;
+    m_excluded_thm = nullptr;
+#ifdef __GLIBC__
+    // The allocator keeps the memory of the queries of a large search for reuse. The queries of later searches are then
+    // spread out over all of it, which makes them considerably slower to reduce. Hence, give the memory back instead.
+    if (large)
+        malloc_trim(0);
+#endif
+}
+
+void Searcher::save(Serializer &serializer) const {
+    // Write the state of the search: its parameters, the results so far, and the queries that are still to be reduced
+    // Note: this must only be called while the search is not running, e.g. after it was interrupted
+    serializer.write(m_excluded_thm);
+    serializer.write_int(m_max_results);
+    serializer.write_int(m_result_counter);
+    serializer.write_int(m_query_counter);
+    serializer.write_int(m_resumable);
+    serializer.write_int(m_results.size());
+    for (const auto &result: m_results)
+        serializer.write(result);
+
+    Query::Serialization serialization;
+    for (const auto queue: {&m_queue, &m_deferred}) {
+        serializer.write_int(queue->size());
+        queue->for_each([&](const std::shared_ptr<Query> &query, int priority) {
+            serializer.write_int((uint64_t) priority);
+            Query::write(serializer, serialization, query);
+        });
+    }
+}
+
+void Searcher::load(Deserializer &deserializer) {
+    // Read a search that was written by `save`, after which it can be resumed (with the same index)
+    clear();
+    m_excluded_thm = deserializer.read();
+    m_max_results = (int) deserializer.read_int();
+    const int result_counter = (int) deserializer.read_int();
+    m_query_counter = (int) deserializer.read_int();
+    m_resumable = deserializer.read_int() != 0;
+    m_single_result = (m_max_results == 1 && !m_resumable);
+    const auto results = deserializer.read_int();
+    for (uint64_t i = 0; i < results; ++i)
+        add_result(deserializer.read_functions());
+    m_result_counter = std::min(result_counter, (int) m_results.size());
+
+    Query::Serialization serialization;
+    for (const auto queue: {&m_queue, &m_deferred}) {
+        const auto size = deserializer.read_int();
+        for (uint64_t i = 0; i < size; ++i) {
+            const int priority = (int) deserializer.read_int();
+            auto query = Query::read(deserializer, serialization);
+            if (query == nullptr)
+                throw SerializationException("invalid query");
+            if (m_single_result && queue == &m_queue)
+                m_frontier.insert(query);
+            queue->push(std::move(query), priority);
+        }
+    }
+    Query::restore_checkpoints(serialization);
+    m_interrupted = true;
 }
 
 bool Searcher::check_reasonable(const std::shared_ptr<Query> &q, const std::shared_ptr<Query> &p) {
     // A query q is reasonable w.r.t. p if p (nor any of its parents) is not easier than q.
-    if (p == nullptr) return true;
-    if (p->checkpoint()) return true; // TODO: only need to check up to the nearest checkpoint !
-    if (is_easier_than(*p, *q)) return false;
-    return check_reasonable(q, p->parent());
+    // Note: most parents are rejected by comparing fingerprints only, see `Query::is_easier_than`
+    if (!q->may_have_easier_parent())
+        return true;
+    int distance = 0;
+    for (std::shared_ptr<Query> r = p; r != nullptr && distance++ < MAX_PARENT_DISTANCE; r = r->parent()) {
+        if (r->has_checkpoint()) return true; // only need to check up to the nearest checkpoint
+        if (is_easier_than(*r, *q)) return false;
+    }
+    return true;
 }
 
 bool Searcher::check_checkpoints(const std::shared_ptr<Query> &query) {
-    // Find the nearest parent with a checkpoint
-    int distance_to_checkpoint = 0;
-    for (const Query *p = query->parent().get(); p != nullptr; p = p->parent().get()) {
-        ++distance_to_checkpoint;
-        auto checkpoint = p->checkpoint();
-        if (checkpoint) {
-            // Make sure that the checkpoint is also one of the parents of query
-            distance_to_checkpoint = 1;
-            const Query *q = query->parent().get();
-            while (q != p && q != checkpoint) {
-                ++distance_to_checkpoint;
-                q = q->parent().get();
-            }
-            if (q == p) // (i.e. checkpoint not found)
-                return false;
+    // Take a snapshot of the parents that are considered at all, up to the nearest parent with a checkpoint.
+    // Note: parents are held by shared pointers, since other threads may release the links between them
+    std::vector<std::shared_ptr<Query>> parents;
+    parents.reserve(MAX_PARENT_DISTANCE);
+    uint64_t checkpoint = Query::NO_CHECKPOINT;
+    for (std::shared_ptr<Query> p = query->parent(); p != nullptr && (int) parents.size() < MAX_PARENT_DISTANCE; p = p->parent()) {
+        parents.push_back(p);
+        // Note: the checkpoint is identified by its id, so it need not be alive anymore
+        checkpoint = p->checkpoint();
+        if (checkpoint != Query::NO_CHECKPOINT)
             break;
-        }
+    }
+    if (checkpoint != Query::NO_CHECKPOINT) {
+        // Make sure that the checkpoint is also one of the parents of query (below the parent that has it)
+        auto it = std::find_if(parents.begin(), parents.end() - 1,
+                               [checkpoint](const std::shared_ptr<Query> &p) { return p->id() == checkpoint; });
+        if (it == parents.end() - 1) // (i.e. checkpoint not found)
+            return false;
+        parents.erase(it + 1, parents.end());
     }
 
     // When query is easier than one of its parents, set the checkpoint of that parent to the query.
     // We want the oldest parent which is still younger or equal to the last checkpoint (to eliminate as many queries as possible)
-    Query *parents[distance_to_checkpoint];
-    Query *p = query.get();
-    for (int i = 0; i < distance_to_checkpoint; ++i)
-        parents[i] = (p = p->parent().get());
-    for (int i = distance_to_checkpoint - 1; i >= 0; --i) {
-        Query &parent = *parents[i];
-        if (!parent.checkpoint() && is_easier_than(*query, parent) && parent.set_checkpoint(*query)) // TODO: multithreading can cause problems?
+    // Once a parent has a checkpoint, its own parents are no longer needed by any query below it: the redundancy
+    // checks stop at the checkpoint, and the final solutions are computed from the traces. So they are released.
+    for (auto it = parents.rbegin(); it != parents.rend(); ++it) {
+        Query &parent = **it;
+        // Note: set_checkpoint fails if another thread has set a checkpoint for this parent in the meantime
+        if (!parent.has_checkpoint() && is_easier_than(*query, parent) && parent.set_checkpoint(*query)) {
+            if (!m_trace)
+                parent.release_parent();
             break;
+        }
     }
 
     return true;
 }
 
-bool contains_in_order(const std::vector<FunctionRef> &v, const std::vector<FunctionRef> &w) {
-    auto it_w = w.begin();
-    for (auto it_v = v.begin(); it_v != v.end(); ++it_v) {
-        while (true) {
-            if (it_w == w.end())
-                return false;
-            if (*it_w == *it_v) {
-                ++it_w;
-                break;
-            }
-            ++it_w;
-        }
-    }
-    return true;
+void Searcher::release_parents(const std::shared_ptr<Query> &query) {
+    // The redundancy checks only consider MAX_PARENT_DISTANCE generations of parents, and the final solutions are
+    // computed from the traces, so older parents are not needed anymore by this query or by any query below it.
+    // Note: other queries between these parents may still have considered them, but they are only used to discard queries
+    if (m_trace)
+        return; // the full chains are kept for the query trees of the results
+    std::shared_ptr<Query> p = query;
+    for (int distance = 0; p != nullptr && distance < MAX_PARENT_DISTANCE; ++distance)
+        p = p->parent();
+    if (p != nullptr)
+        p->release_parent();
 }
 
 bool Searcher::is_easier_than(const Query &p, const Query &q) {
     if (!m_searching)
         return false;
 
-    const auto &p_variables = p.telescope().functions();
-    const auto &q_variables = q.telescope().functions();
-
-    if (p_variables.size() > q_variables.size()) // If p has more questions than q, return false
-        return false;
-
-    const auto &p_locals = p.locals();
-    const auto &q_locals = q.locals();
-
-    if (q_locals.size() > p_locals.size()) // If q has more local variables than p (i.e. more information), return false
-        return false;
-
-    // If p has a question that q does not have, return false
-    if (!contains_in_order(p_variables, q_variables))
-        return false;
-
-    // If q has a local variable that p does not have, return false
-    for (auto it_p = p_locals.begin(), it_q = q_locals.begin(); it_p < p_locals.end(); ++it_p, ++it_q) {
-        if (!contains_in_order(*it_q, *it_p))
-            return false;
-    }
-
-    return true;
+    return p.is_easier_than(q);
 }
@@ -7,40 +7,51 @@
 #include "Query.h"
 #include "ThreadManager.h"
 #include "Index.h"
+#include "Frontier.h"
+#include "QueryQueue.h"
 #include "../data/Context.h"
-#include <queue>
 #include <mutex>
 #include <set>
+#include <unordered_map>
 #include <atomic>
-
-struct QueryEntry {
-
-    std::shared_ptr<Query> query;
-    std::vector<int> order;
-
-    bool operator<(const QueryEntry &other) const {
-        if (query->complexity() != other.query->complexity())
-            return query->complexity() > other.query->complexity();
-        return order > other.order; // compare lexicographically
-    }
-};
+#include <functional>
 
 class Searcher {
 public:
 
-    Searcher(const std::unordered_set<Context *> &, int max_depth, int max_threads = 1);
+    Searcher(std::shared_ptr<const Index>, int max_depth, int max_threads = 1, int max_premises = 0, int max_queries = 0);
 
-    bool search(const Telescope &, int max_results = 1);
+    // Called for every result as soon as it is found (while holding the lock of the searcher)
+    typedef std::function<void(const std::vector<FunctionRef> &)> ResultCallback;
+
+    bool search(const Telescope &, int max_results = 1, bool resumable = false);
+    bool resume(int max_results);
+    bool can_resume() const;
     bool prove(const FunctionRef &);
+    void set_result_callback(ResultCallback);
+    void set_index(std::shared_ptr<const Index>);
     void clear();
 
-    Index &index() { return m_index; }
+    // A search is interrupted (i.e. paused) once the given flag is set, after which it can be saved or resumed
+    void set_interrupt(const std::atomic<bool> *);
+    // When tracing, the full chains of parents are kept, and the query tree of every result is logged
+    void set_trace(bool trace) { m_trace = trace; }
+    bool interrupted() const { return m_interrupted; }
+    bool resume();
+    void save(Serializer &) const;
+    void load(Deserializer &);
+
+    const Index &index() const { return *m_index; }
     const std::vector<std::vector<FunctionRef>> &results() const { return m_results; }
 
     int query_counter() const { return m_query_counter; }
 
 private:
 
+    static const int DEFERRED_PENALTY = 10000; // as if the query had one more goal
+    static const int MAX_PARENT_DISTANCE = 16; // generations of parents considered by the redundancy checks, older parents are released
+    static const int LARGE_SEARCH = 100000; // number of queries after which the memory of a search is given back when cleared
+
     enum SearchResult {
         SEARCH_CONTINUE, // continue searching
         SEARCH_STOP, // stop searching for this query
@@ -48,22 +59,47 @@ private:
     };
 
     const int m_max_depth;
+    const int m_max_premises; // number of theorems tried in the first pass for a generic goal (0 for all of them)
+    const int m_max_queries; // number of queries after which a search gives up (0 for no limit)
     std::atomic<bool> m_searching;
+    std::atomic<bool> m_pausing{false}; // set when a resumable search has found its results
     int m_max_results = 0;
+    bool m_single_result = false; // searching for a single result, which allows to discard more queries
+    bool m_resumable = false; // a resumable search keeps its queue after pausing, see `resume`
+    bool m_trace = false; // see `set_trace`
+    const std::atomic<bool> *m_interrupt = nullptr;
+    std::atomic<bool> m_interrupted{false};
     int m_result_counter = 0;
     int m_query_counter = 0;
 
     ThreadManager m_thread_manager;
     std::mutex m_mutex;
-    std::priority_queue<QueryEntry, std::vector<QueryEntry>> m_queue;
+    QueryQueue m_queue;
+    QueryQueue m_deferred; // queries for which the theorems that were not selected as premises are still to be tried
+    Frontier m_frontier; // used when searching for a single result
     std::vector<std::vector<FunctionRef>> m_results;
+    std::unordered_map<size_t, std::vector<size_t>> m_result_hashes; // indices of the results by their hash, to omit identical results
+    ResultCallback m_result_callback;
     FunctionRef m_excluded_thm; // used for `prove()`
-    Index m_index;
+    std::shared_ptr<const Index> m_index; // shared with other searchers, see `Session::index`
 
+    bool start(const Telescope &, int max_results = 1, bool resumable = false);
+    void run();
+    void deliver(const std::vector<FunctionRef> &);
     void search_loop();
-    SearchResult search_helper(const std::shared_ptr<Query> &, const FunctionRef &, std::vector<std::shared_ptr<Query>> &);
+    SearchResult search_premises(const std::shared_ptr<Query> &, const std::vector<Index::Theorem> &, bool,
+                                 std::vector<std::shared_ptr<Query>> &, Query::Workspace &, bool &);
+    std::vector<bool> select_premises(const Query &, const std::vector<Index::Theorem> &) const;
+    SearchResult search_helper(const std::shared_ptr<Query> &, const FunctionRef &, const MatchProgram *,
+                               std::vector<std::shared_ptr<Query>> &, Query::Workspace &);
+    bool is_excluded(const Index::Theorem &thm) const { return m_excluded_thm != nullptr && thm.depends_on(m_excluded_thm); }
+    bool add_result(std::vector<FunctionRef>);
+    void remove_duplicates(std::vector<std::shared_ptr<Query>> &);
+    void rank_reductions(std::vector<std::shared_ptr<Query>> &) const;
+    size_t estimate_fan_out(const Query &) const;
     bool check_reasonable(const std::shared_ptr<Query> &q, const std::shared_ptr<Query> &p);
     bool check_checkpoints(const std::shared_ptr<Query> &);
+    void release_parents(const std::shared_ptr<Query> &);
 
     bool is_easier_than(const Query &, const Query &);
 
@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+# Checks that the server keeps answering requests after requests that fail
+# Usage: tests/test_server.sh <path to canard executable>
+
+CANARD=${1:?"usage: $0 <path to canard executable>"}
+DIR=$(mktemp -d)
+trap 'kill $PID 2> /dev/null; rm -rf "$DIR"' EXIT
+
+printf 'let Color : Type\nlet red : Color\n' > "$DIR/colors.cnd"
+"$CANARD" --server "$DIR/socket" "$DIR/colors.cnd" 2> /dev/null &
+PID=$!
+for _ in $(seq 50); do
+  [ -S "$DIR/socket" ] && break
+  sleep 0.1
+done
+
+python3 - "$DIR/socket" << 'EOF'
+import socket
+import sys
+
+# Pairs of a request and the expected response
+cases = [
+    ('{"jsonrpc":"2.0","id":1,"method":"search","params":{"input":"99999999999 (c : Color)"}}',
+     '{"jsonrpc":"2.0","id":1,"result":[{"status":"error","data":"Parsing error: number 99999999999 is out of range"}]}'),
+    ('{"jsonrpc":',
+     '{"jsonrpc":"2.0","id":null,"error":{"code":-32700,"message":"parse error: unexpected end of request"}}'),
+    ('{"jsonrpc":"2.0","id":3,"method":"search","params":{"input":"(c : Color)"}}',
+     '{"jsonrpc":"2.0","id":3,"result":[{"status":"success","data":[{"c":"red"}]}]}'),
+]
+
+client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+client.connect(sys.argv[1])
+stream = client.makefile('rw')
+failed = False
+for request, expected in cases:
+    stream.write(request + '\n')
+    stream.flush()
+    response = stream.readline().strip()
+    if response != expected:
+        print('request:  ' + request + '\nexpected: ' + expected + '\ngot:      ' + response)
+        failed = True
+sys.exit(1 if failed else 0)
+EOF
+STATUS=$?
+[ $STATUS -eq 0 ] && echo "ok" || echo "failed"
+exit $STATUS
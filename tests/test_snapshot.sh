@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+# Checks that searches give the same results after loading a snapshot of the library as after parsing it
+# Usage: tests/test_snapshot.sh <path to canard executable>
+
+CANARD=${1:?"usage: $0 <path to canard executable>"}
+LIBRARY="$(cd "$(dirname "$0")/../math" && pwd)/main.cnd"
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+cat > "$DIR/searches.cnd" << 'EOF'
+open *
+search 3 (X : Scheme) (h : scheme.affine X);
+search (P (X : Scheme) (h : scheme.affine X) : scheme.quasi_separated X);
+search (X Y : Scheme) (f : Morphism X Y);
+search (X : Space) (h1 : first_countable X) (h2 : separable X) (h3 : not (second_countable X));
+EOF
+
+# The first run parses the library and writes the snapshot, the second run loads it
+"$CANARD" --snapshot "$DIR/snapshot" "$LIBRARY" < "$DIR/searches.cnd" > "$DIR/parsed.txt" 2> /dev/null
+"$CANARD" --snapshot "$DIR/snapshot" "$LIBRARY" < "$DIR/searches.cnd" > "$DIR/loaded.txt" 2> "$DIR/loaded.log"
+
+STATUS=0
+if ! grep -q "Loading snapshot" "$DIR/loaded.log"; then
+  echo "snapshot was not loaded"
+  STATUS=1
+elif [ "$(grep -c '🔎' "$DIR/parsed.txt")" -ne 6 ] || ! diff "$DIR/parsed.txt" "$DIR/loaded.txt"; then
+  echo "results differ (or are missing) after loading the snapshot"
+  STATUS=1
+fi
+[ $STATUS -eq 0 ] && echo "ok" || echo "failed"
+exit $STATUS